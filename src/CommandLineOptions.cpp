@@ -3,6 +3,11 @@
  */
 
 #include "CommandLineOptions.h"
+#include "settings.h"
+
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
 
 struct CommandLineOptionsSingleton {
     CommandLineOptions self;
@@ -14,3 +19,122 @@ CommandLineOptions *CommandLineOptions::self()
 {
     return &privateCommandLineOptionsSelf()->self;
 }
+
+CommandLineOptions::Values CommandLineOptions::values(const QCommandLineParser &parser)
+{
+    Values values;
+    values.fill(false);
+    const auto &allOptions = self()->allOptions;
+    int optionsToCheck = parser.optionNames().size();
+    for (int i = 0; optionsToCheck > 0 && i < allOptions.size(); ++i) {
+        values[i] = parser.isSet(allOptions[i]);
+        if (values[i]) {
+            --optionsToCheck;
+        }
+    }
+    return values;
+}
+
+CommandLineOptions::StartMode CommandLineOptions::startMode(const Values &values)
+{
+    // Gui is an option that's normally useless since it's the default mode.
+    // Make it override the other modes if explicitly set, using the launchonly option,
+    // or editing an existing image. Editing an existing image requires a viewer window.
+    if (values[Gui] || values[LaunchOnly] || values[EditExisting]) {
+        return StartMode::Gui;
+    }
+    // Background gets precedence over DBus
+    if (values[Background]) {
+        return StartMode::Background;
+    } else if (values[DBus]) {
+        return StartMode::DBus;
+    }
+    return StartMode::Gui;
+}
+
+CommandLineOptions::CaptureSettings CommandLineOptions::captureSettings(StartMode startMode, const Values &values)
+{
+    CaptureSettings settings;
+    if (startMode == StartMode::Background) {
+        settings.transientOnly = values[TransientOnly];
+        settings.onClick = values[OnClick];
+        settings.includeDecorations = !values[NoDecoration];
+        settings.includePointer = values[Pointer];
+        settings.includeShadow = !values[NoShadow];
+    } else {
+        settings.transientOnly = Settings::transientOnly() || values[TransientOnly];
+        settings.onClick = Settings::captureOnClick() || values[OnClick];
+        settings.includeDecorations = Settings::includeDecorations() && !values[NoDecoration];
+        settings.includeShadow = Settings::includeShadow() && !values[NoShadow];
+        settings.includePointer = Settings::includePointer() || values[Pointer];
+    }
+    return settings;
+}
+
+int CommandLineOptions::delay(const QCommandLineParser &parser, bool onClick)
+{
+    if (onClick) {
+        return -1;
+    }
+    // default to 0 if cli value parse fails
+    bool parseOk = false;
+    const int value = parser.value(self()->delay).toInt(&parseOk);
+    return parseOk ? value : 0;
+}
+
+std::optional<ImagePlatform::GrabMode> CommandLineOptions::grabMode(const Values &values)
+{
+    using GrabMode = ImagePlatform::GrabMode;
+    if (values[Scaled] && !values[Fullscreen]) {
+        qWarning().noquote() << i18nc("@info:shell", "--scaled is only allowed together with -f/--fullscreen and will be ignored");
+    }
+    if (values[Fullscreen]) {
+        return values[Scaled] ? GrabMode::AllScreensScaled : GrabMode::AllScreens;
+    } else if (values[Current]) {
+        return GrabMode::CurrentScreen;
+    } else if (values[ActiveWindow]) {
+        return GrabMode::ActiveWindow;
+    } else if (values[Region]) {
+        return GrabMode::PerScreenImageNative;
+    } else if (values[WindowUnderCursor]) {
+        return GrabMode::WindowUnderCursor;
+    }
+    return std::nullopt;
+}
+
+QUrl CommandLineOptions::outputUrl(const QCommandLineParser &parser, Values &values)
+{
+    if (!values[Output]) {
+        return {};
+    }
+    const auto url = QUrl::fromUserInput(parser.value(self()->output), QDir::currentPath(), QUrl::AssumeLocalFile);
+    if (!url.isValid()) {
+        values[Output] = false;
+        return {};
+    }
+    return url;
+}
+
+ExportManager::Actions CommandLineOptions::autoExportActions(StartMode startMode, const Values &values, bool videoMode)
+{
+    using Action = ExportManager::Action;
+    bool save = (startMode != StartMode::Gui && values[Output]) || videoMode;
+    bool copyImage = values[CopyImage] && !videoMode;
+    bool copyPath = values[CopyPath];
+    ExportManager::Actions actions;
+    if (startMode != StartMode::Background) {
+        save |= Settings::autoSaveImage();
+        copyImage |= Settings::clipboardGroup() == Settings::PostScreenshotCopyImage && !videoMode;
+        copyPath |= Settings::clipboardGroup() == Settings::PostScreenshotCopyLocation;
+    }
+    if (startMode == StartMode::Gui) {
+        actions.setFlag(Action::Save, save);
+        actions.setFlag(Action::CopyImage, copyImage);
+    } else {
+        // In background and dbus mode, ensure that either save or copy image is enabled.
+        actions.setFlag(Action::Save, save || !copyImage);
+        actions.setFlag(Action::CopyImage, !actions.testFlag(Action::Save) || copyImage);
+    }
+    actions.setFlag(Action::CopyPath, actions.testFlag(Action::Save) && copyPath);
+    return actions;
+}
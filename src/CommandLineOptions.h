@@ -4,9 +4,18 @@
 
 #pragma once
 
+#include "ExportManager.h"
+#include "Platforms/ImagePlatform.h"
+
 #include <KLocalizedString>
 #include <QCommandLineOption>
 #include <QList>
+#include <QUrl>
+
+#include <array>
+#include <optional>
+
+class QCommandLineParser;
 
 using namespace Qt::StringLiterals;
 
@@ -149,4 +158,61 @@ struct CommandLineOptions {
         ReleaseCapture,
         TotalOptions
     };
+
+    // Whether each of allOptions is set, indexed by Option.
+    using Values = std::array<bool, TotalOptions>;
+
+    enum class StartMode {
+        Gui = 0,
+        DBus = 1,
+        Background = 2,
+    };
+
+    // The capture options that come from the settings unless Spectacle runs in background mode.
+    struct CaptureSettings {
+        bool transientOnly = false;
+        bool onClick = false;
+        bool includeDecorations = true;
+        bool includePointer = false;
+        bool includeShadow = true;
+    };
+
+    /* The functions below are used both by SpectacleCore and by HeadlessCapture,
+     * so that a background capture does the same with and without SpectacleCore.
+     */
+
+    static Values values(const QCommandLineParser &parser);
+
+    static StartMode startMode(const Values &values);
+
+    /**
+     * Gui/DBus: Prioritise command line options and default to saved settings.
+     * Background: Prioritise command line options and use defaults based on
+     * how command line options are meant to be used.
+     */
+    static CaptureSettings captureSettings(StartMode startMode, const Values &values);
+
+    /**
+     * The delay in milliseconds, or -1 to capture on click.
+     * Never start with a delay by default. It is annoying and confuses users
+     * when nothing happens immediately after starting spectacle.
+     */
+    static int delay(const QCommandLineParser &parser, bool onClick);
+
+    /**
+     * The grab mode of the capture mode option, if one is set.
+     * Warns about options that are ignored.
+     */
+    static std::optional<ImagePlatform::GrabMode> grabMode(const Values &values);
+
+    /**
+     * The URL of the output option, or an empty URL if it isn't set.
+     * The option is unset in @p values if the URL is invalid.
+     */
+    static QUrl outputUrl(const QCommandLineParser &parser, Values &values);
+
+    /**
+     * The export actions to do automatically after a screenshot or recording.
+     */
+    static ExportManager::Actions autoExportActions(StartMode startMode, const Values &values, bool videoMode);
 };
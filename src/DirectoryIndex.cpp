@@ -0,0 +1,239 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "DirectoryIndex.h"
+#include "DebugUtils.h"
+
+#include <KDirWatch>
+#include <KIO/ListJob>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+
+#include <chrono>
+
+#include <sys/stat.h>
+
+using namespace std::chrono_literals;
+using namespace Qt::StringLiterals;
+
+// How long a listing of a remote directory is trusted.
+static constexpr auto s_remoteExpiry = 5s;
+// File systems may only update modification times every few milliseconds. A listing made
+// this soon after the last modification could miss a change that didn't update the time.
+static constexpr qint64 s_modificationTimeGranularity = 50'000'000;
+
+static QUrl dirUrlOf(const QUrl &url)
+{
+    return url.adjusted(QUrl::RemoveFilename | QUrl::StripTrailingSlash);
+}
+
+// The modification time of a local directory in nanoseconds, or 0 if it doesn't exist.
+static qint64 modificationTime(const QString &path)
+{
+    struct stat statBuffer;
+    if (::stat(QFile::encodeName(path).constData(), &statBuffer) != 0) {
+        return 0;
+    }
+    return qint64(statBuffer.st_mtim.tv_sec) * 1000000000 + statBuffer.st_mtim.tv_nsec;
+}
+
+// Whether a local entry is listed by QDir::Files, which is what counts for sequences.
+static bool isSequenceFile(const QFileInfo &info)
+{
+    return info.isFile() && !info.isHidden();
+}
+
+// The number in a name, or -1 if the name doesn't match.
+static int sequenceNumber(const QRegularExpression &regex, const QString &name)
+{
+    const auto match = regex.match(name);
+    return match.hasMatch() ? match.capturedView(1).toInt() : -1;
+}
+
+DirectoryIndex::DirectoryIndex(QObject *parent)
+    : QObject(parent)
+    , m_dirWatch(new KDirWatch(this))
+{
+    connect(m_dirWatch, &KDirWatch::created, this, &DirectoryIndex::onCreated);
+    connect(m_dirWatch, &KDirWatch::deleted, this, &DirectoryIndex::onDeleted);
+    connect(m_dirWatch, &KDirWatch::dirty, this, &DirectoryIndex::onDirty);
+}
+
+DirectoryIndex *DirectoryIndex::instance()
+{
+    static DirectoryIndex instance;
+    return &instance;
+}
+
+bool DirectoryIndex::contains(const QUrl &url)
+{
+    const auto fileName = url.fileName();
+    if (fileName.isEmpty()) {
+        return false;
+    }
+    return directory(dirUrlOf(url)).names.contains(fileName);
+}
+
+int DirectoryIndex::highestNumber(const QString &dirPath, const QString &pattern)
+{
+    auto &directory = this->directory(QUrl::fromLocalFile(QDir(dirPath).absolutePath()));
+    auto &sequence = directory.sequences[pattern];
+    if (!sequence.valid) {
+        sequence.regex.setPattern(pattern);
+        sequence.highest = 0;
+        for (const auto &name : std::as_const(directory.files)) {
+            sequence.highest = std::max(sequence.highest, sequenceNumber(sequence.regex, name));
+        }
+        sequence.valid = true;
+    }
+    return sequence.highest;
+}
+
+void DirectoryIndex::insert(const QUrl &url)
+{
+    const auto dirUrl = dirUrlOf(url);
+    auto it = m_directories.find(dirUrl);
+    if (it == m_directories.end() || !it->valid) {
+        return;
+    }
+    const bool isFile = url.isLocalFile() ? isSequenceFile(QFileInfo(url.toLocalFile())) : !url.fileName().startsWith(u'.');
+    addName(*it, url.fileName(), isFile);
+    if (dirUrl.isLocalFile()) {
+        // Our own change, don't list the directory again because of it.
+        it->mtime = modificationTime(dirUrl.toLocalFile());
+    }
+}
+
+void DirectoryIndex::invalidate(const QUrl &dirUrl)
+{
+    auto it = m_directories.find(dirUrl.adjusted(QUrl::StripTrailingSlash));
+    if (it != m_directories.end()) {
+        it->valid = false;
+        it->names.clear();
+        it->files.clear();
+        it->sequences.clear();
+    }
+}
+
+DirectoryIndex::Directory &DirectoryIndex::directory(const QUrl &dirUrl)
+{
+    auto it = m_directories.find(dirUrl);
+    if (it != m_directories.end() && it->valid) {
+        // A stat of the directory is cheap compared to listing it. It catches changes
+        // that happened before the file system watcher's notifications were delivered.
+        const bool current = dirUrl.isLocalFile() //
+            ? !it->racy && it->mtime == modificationTime(dirUrl.toLocalFile())
+            : !it->expiry.hasExpired();
+        if (current) {
+            return *it;
+        }
+    }
+    // Remote listings run a nested event loop, so only touch the hash once the listing is done.
+    Directory listed;
+    list(dirUrl, listed);
+    auto &directory = m_directories[dirUrl];
+    directory = std::move(listed);
+    Log::debug() << "Indexed" << directory.names.size() << "names in" << dirUrl;
+    return directory;
+}
+
+void DirectoryIndex::list(const QUrl &dirUrl, Directory &directory)
+{
+    if (dirUrl.isLocalFile()) {
+        const auto path = dirUrl.toLocalFile();
+        // Watch before listing so that no change in between is missed.
+        if (!m_dirWatch->contains(path)) {
+            m_dirWatch->addDir(path, KDirWatch::WatchFiles);
+        }
+        directory.mtime = modificationTime(path);
+        directory.racy = QDateTime::currentMSecsSinceEpoch() * 1000000 - directory.mtime < s_modificationTimeGranularity;
+        const QDir dir(path);
+        const auto entries = dir.entryList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+        directory.names = QSet<QString>(entries.cbegin(), entries.cend());
+        const auto files = dir.entryList(QDir::Files);
+        directory.files = QSet<QString>(files.cbegin(), files.cend());
+    } else {
+        // One listing instead of one stat job for every name that is checked.
+        auto listJob = KIO::listDir(dirUrl, KIO::HideProgressInfo);
+        connect(listJob, &KIO::ListJob::entries, this, [&directory](KIO::Job *, const KIO::UDSEntryList &entries) {
+            for (const auto &entry : entries) {
+                const auto name = entry.stringValue(KIO::UDSEntry::UDS_NAME);
+                if (name == "."_L1 || name == ".."_L1) {
+                    continue;
+                }
+                directory.names.insert(name);
+                if (!entry.isDir() && !name.startsWith(u'.')) {
+                    directory.files.insert(name);
+                }
+            }
+        });
+        listJob->exec();
+        directory.expiry.setRemainingTime(s_remoteExpiry);
+    }
+    directory.valid = true;
+}
+
+void DirectoryIndex::addName(Directory &directory, const QString &name, bool isFile)
+{
+    directory.names.insert(name);
+    if (!isFile) {
+        return;
+    }
+    directory.files.insert(name);
+    for (auto &sequence : directory.sequences) {
+        if (sequence.valid) {
+            sequence.highest = std::max(sequence.highest, sequenceNumber(sequence.regex, name));
+        }
+    }
+}
+
+void DirectoryIndex::removeName(Directory &directory, const QString &name)
+{
+    directory.names.remove(name);
+    if (!directory.files.remove(name)) {
+        return;
+    }
+    // Only the highest number can change, and only when the file that had it is gone.
+    for (auto &sequence : directory.sequences) {
+        if (sequence.valid && sequenceNumber(sequence.regex, name) == sequence.highest) {
+            sequence.valid = false;
+        }
+    }
+}
+
+void DirectoryIndex::onCreated(const QString &path)
+{
+    const auto url = QUrl::fromLocalFile(path);
+    const auto dirUrl = dirUrlOf(url);
+    auto it = m_directories.find(dirUrl);
+    if (it != m_directories.end() && it->valid) {
+        addName(*it, url.fileName(), isSequenceFile(QFileInfo(path)));
+        it->mtime = modificationTime(dirUrl.toLocalFile());
+    }
+}
+
+void DirectoryIndex::onDeleted(const QString &path)
+{
+    const auto url = QUrl::fromLocalFile(path);
+    const auto dirUrl = dirUrlOf(url);
+    auto it = m_directories.find(dirUrl);
+    if (it != m_directories.end() && it->valid) {
+        removeName(*it, url.fileName());
+        it->mtime = modificationTime(dirUrl.toLocalFile());
+    }
+    // The directory itself may have been removed.
+    invalidate(url);
+}
+
+void DirectoryIndex::onDirty(const QString &path)
+{
+    // Without inotify, changes in a directory are only reported as the directory being dirty.
+    if (m_dirWatch->internalMethod() != KDirWatch::INotify) {
+        invalidate(QUrl::fromLocalFile(path));
+    }
+}
+
+#include "moc_DirectoryIndex.cpp"
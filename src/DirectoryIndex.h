@@ -0,0 +1,92 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QObject>
+#include <QRegularExpression>
+#include <QSet>
+#include <QUrl>
+
+class KDirWatch;
+
+/**
+ * An index of the names in the directories Spectacle saves to.
+ *
+ * Each directory is listed once, locally or through KIO. Local directories are
+ * then kept up to date with KDirWatch and a check of the directory's modification
+ * time, while remote listings are refreshed after a few seconds. This makes checking
+ * whether a file name is taken a hash lookup instead of a stat job.
+ */
+class DirectoryIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    static DirectoryIndex *instance();
+
+    /**
+     * Whether a file or directory exists at the URL.
+     * Lists the parent directory if it isn't indexed yet.
+     */
+    bool contains(const QUrl &url);
+
+    /**
+     * The highest number captured by the first group of @p pattern
+     * in the names of the files in a local directory, or 0 if no name matches.
+     *
+     * The result is kept per directory and pattern and updated as files are added,
+     * so only the first call for a pattern has to look at every name.
+     */
+    int highestNumber(const QString &dirPath, const QString &pattern);
+
+    /**
+     * Add a file that Spectacle has written, so that it is known
+     * before the file system watcher or the next listing catches up.
+     */
+    void insert(const QUrl &url);
+
+    /**
+     * Forget what is known about a directory. It will be listed again when needed.
+     */
+    void invalidate(const QUrl &dirUrl);
+
+private:
+    explicit DirectoryIndex(QObject *parent = nullptr);
+
+    // The highest number of a numbered file name pattern.
+    struct Sequence {
+        QRegularExpression regex;
+        int highest = 0;
+        bool valid = false;
+    };
+
+    struct Directory {
+        // Every entry, including hidden files and subdirectories, which all make a name taken.
+        QSet<QString> names;
+        // Only the visible files count for sequences, like QDir::Files lists them.
+        QSet<QString> files;
+        QHash<QString, Sequence> sequences;
+        // Local directories are listed again when their modification time changes unexpectedly.
+        qint64 mtime = 0;
+        // Whether the listing was made too soon after the last modification to rely on the time.
+        bool racy = false;
+        // Only used for remote directories, local ones are watched instead.
+        QDeadlineTimer expiry;
+        bool valid = false;
+    };
+
+    Directory &directory(const QUrl &dirUrl);
+    void list(const QUrl &dirUrl, Directory &directory);
+    void addName(Directory &directory, const QString &name, bool isFile);
+    void removeName(Directory &directory, const QString &name);
+    void onCreated(const QString &path);
+    void onDeleted(const QString &path);
+    void onDirty(const QString &path);
+
+    QHash<QUrl, Directory> m_directories;
+    KDirWatch *m_dirWatch;
+};
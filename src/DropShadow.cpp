@@ -0,0 +1,185 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "DropShadow.h"
+
+#include <QPainter>
+#include <QtConcurrentMap>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Rows or columns handled by one task. Small images are blurred on the calling thread.
+static constexpr int s_chunkSize = 128;
+
+// Box sizes for a number of box blur passes that approximate a gaussian with the given sigma.
+// See "Fast Almost-Gaussian Filtering" by Peter Kovesi.
+static std::array<int, 3> boxRadiiForGaussian(qreal sigma)
+{
+    constexpr int passes = 3;
+    const qreal idealWidth = std::sqrt(12 * sigma * sigma / passes + 1);
+    int lowerWidth = std::floor(idealWidth);
+    if (lowerWidth % 2 == 0) {
+        --lowerWidth;
+    }
+    const qreal idealLowerPasses = (12 * sigma * sigma - passes * lowerWidth * lowerWidth - 4 * passes * lowerWidth - 3 * passes) / (-4 * lowerWidth - 4);
+    const int lowerPasses = std::round(idealLowerPasses);
+    std::array<int, 3> radii;
+    for (int i = 0; i < passes; ++i) {
+        const int width = i < lowerPasses ? lowerWidth : lowerWidth + 2;
+        radii[i] = std::max(0, (width - 1) / 2);
+    }
+    return radii;
+}
+
+// Runs function(begin, end) for chunks of [0, count), in parallel when there is more than one chunk.
+template<typename Function>
+static void forEachChunk(int count, Function function)
+{
+    if (count <= s_chunkSize) {
+        function(0, count);
+        return;
+    }
+    QList<int> chunks;
+    for (int begin = 0; begin < count; begin += s_chunkSize) {
+        chunks << begin;
+    }
+    QtConcurrent::blockingMap(chunks, [&](int begin) {
+        function(begin, std::min(begin + s_chunkSize, count));
+    });
+}
+
+// Divides a box sum by the box width with a fixed point reciprocal.
+static inline uchar boxAverage(uint sum, uint reciprocal)
+{
+    return (sum * reciprocal + 0x8000) >> 16;
+}
+
+static void blurRow(const uchar *in, uchar *out, int width, int radius)
+{
+    const uint reciprocal = (0x10000 + radius) / (2 * radius + 1);
+    uint sum = 0;
+    for (int x = 0; x < std::min(radius, width - 1) + 1; ++x) {
+        sum += in[x];
+    }
+    for (int x = 0; x < width; ++x) {
+        out[x] = boxAverage(sum, reciprocal);
+        if (x + radius + 1 < width) {
+            sum += in[x + radius + 1];
+        }
+        if (x - radius >= 0) {
+            sum -= in[x - radius];
+        }
+    }
+}
+
+// Blurs columns [begin, end) of a plane. The inner loops run along rows so they can be vectorized.
+static void blurColumns(const uchar *in, uchar *out, int stride, int height, int begin, int end, int radius)
+{
+    const uint reciprocal = (0x10000 + radius) / (2 * radius + 1);
+    const int count = end - begin;
+    std::vector<uint> sums(count, 0);
+    for (int y = 0; y < std::min(radius, height - 1) + 1; ++y) {
+        const uchar *line = in + y * stride + begin;
+        for (int x = 0; x < count; ++x) {
+            sums[x] += line[x];
+        }
+    }
+    for (int y = 0; y < height; ++y) {
+        uchar *outLine = out + y * stride + begin;
+        for (int x = 0; x < count; ++x) {
+            outLine[x] = boxAverage(sums[x], reciprocal);
+        }
+        if (y + radius + 1 < height) {
+            const uchar *line = in + (y + radius + 1) * stride + begin;
+            for (int x = 0; x < count; ++x) {
+                sums[x] += line[x];
+            }
+        }
+        if (y - radius >= 0) {
+            const uchar *line = in + (y - radius) * stride + begin;
+            for (int x = 0; x < count; ++x) {
+                sums[x] -= line[x];
+            }
+        }
+    }
+}
+
+DropShadow::DropShadow(int blurRadius, const QColor &color)
+    : m_blurRadius(std::max(0, blurRadius))
+    , m_boxRadii(boxRadiiForGaussian(m_blurRadius / 2.0))
+{
+    const auto rgb = color.rgba();
+    for (int i = 0; i < 256; ++i) {
+        m_colorTable[i] = qPremultiply(qRgba(qRed(rgb), qGreen(rgb), qBlue(rgb), (i * qAlpha(rgb) + 127) / 255));
+    }
+}
+
+int DropShadow::blurRadius() const
+{
+    return m_blurRadius;
+}
+
+QImage DropShadow::apply(const QImage &image) const
+{
+    if (image.isNull()) {
+        return image;
+    }
+
+    const int margin = m_blurRadius;
+    const int width = image.width() + 2 * margin;
+    const int height = image.height() + 2 * margin;
+
+    // The alpha plane of the enlarged image, with a transparent margin.
+    std::vector<uchar> plane(size_t(width) * height, 0);
+    std::vector<uchar> buffer(plane.size());
+    const auto alpha = image.hasAlphaChannel() ? image.convertToFormat(QImage::Format_Alpha8) : QImage();
+    forEachChunk(image.height(), [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            uchar *line = plane.data() + size_t(y + margin) * width + margin;
+            if (alpha.isNull()) {
+                std::memset(line, 0xff, image.width());
+            } else {
+                std::memcpy(line, alpha.constScanLine(y), image.width());
+            }
+        }
+    });
+
+    for (int radius : m_boxRadii) {
+        if (radius == 0) {
+            continue;
+        }
+        forEachChunk(height, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                blurRow(plane.data() + size_t(y) * width, buffer.data() + size_t(y) * width, width, radius);
+            }
+        });
+        forEachChunk(width, [&](int begin, int end) {
+            blurColumns(buffer.data(), plane.data(), width, height, begin, end, radius);
+        });
+    }
+
+    QImage shadowImage(width, height, QImage::Format_ARGB32_Premultiplied);
+    uchar *shadowBits = shadowImage.bits();
+    const auto shadowBytesPerLine = shadowImage.bytesPerLine();
+    forEachChunk(height, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const uchar *in = plane.data() + size_t(y) * width;
+            auto out = reinterpret_cast<QRgb *>(shadowBits + y * shadowBytesPerLine);
+            for (int x = 0; x < width; ++x) {
+                out[x] = m_colorTable[in[x]];
+            }
+        }
+    });
+
+    // Draw the image pixel for pixel, regardless of its device pixel ratio.
+    QImage source = image;
+    source.setDevicePixelRatio(1);
+    QPainter painter(&shadowImage);
+    painter.drawImage(margin, margin, source);
+    painter.end();
+    shadowImage.setDevicePixelRatio(image.devicePixelRatio());
+    return shadowImage;
+}
@@ -0,0 +1,39 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <QColor>
+#include <QImage>
+
+#include <array>
+
+/**
+ * Generates client-side drop shadows for images.
+ *
+ * Only the alpha channel of the image is blurred, using three box blur passes
+ * in each direction to approximate a gaussian blur. The box sizes and the
+ * shadow colour table are computed once per instance, so keep instances around.
+ */
+class DropShadow
+{
+public:
+    /**
+     * @param blurRadius The blur radius, also used as the margin around the image.
+     * @param color The shadow colour. Its alpha is the opacity of a fully opaque source.
+     */
+    explicit DropShadow(int blurRadius = 20, const QColor &color = QColor(63, 63, 63, 180));
+
+    int blurRadius() const;
+
+    /**
+     * Returns the image on top of its shadow, enlarged by the blur radius on each side.
+     */
+    QImage apply(const QImage &image) const;
+
+private:
+    int m_blurRadius;
+    std::array<int, 3> m_boxRadii;
+    std::array<QRgb, 256> m_colorTable;
+};
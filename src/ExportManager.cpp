@@ -6,6 +6,7 @@
 
 #include "ExportManager.h"
 #include "DebugUtils.h"
+#include "DirectoryIndex.h"
 #include "ImageMetaData.h"
 #include "settings.h"
 
@@ -13,35 +14,47 @@
 #include <QBuffer>
 #include <QClipboard>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoopLocker>
 #include <QFileDialog>
+#include <QHash>
 #include <QImageWriter>
 #include <QLocale>
 #include <QLockFile>
+#include <QMutex>
 #include <QMimeData>
 #include <QMimeDatabase>
 #include <QPainter>
+#include <QPointer>
 #include <QPrinter>
 #include <QRandomGenerator>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
 #include <QSaveFile>
+#include <QSet>
 #include <QString>
 #include <QTemporaryDir>
 #include <QTemporaryFile>
 #include <QtConcurrent/QtConcurrentRun>
 #include <QTimer>
+#include <QVarLengthArray>
+#include <QWaitCondition>
 
 #include <KIO/DeleteJob>
 #include <KIO/FileCopyJob>
 #include <KIO/ListJob>
 #include <KIO/MkpathJob>
-#include <KIO/StatJob>
+#include <KIO/TransferJob>
 #include <KRecentDocument>
 #include <KSharedConfig>
 #include <KSystemClipboard>
 #include <Prison/ImageScanner>
 #include <Prison/ScanResult>
 
+#include <algorithm>
+#include <atomic>
+#include <optional>
+
 using namespace Qt::StringLiterals;
 
 ExportManager::ExportManager(QObject *parent)
@@ -49,6 +62,7 @@ ExportManager::ExportManager(QObject *parent)
     , m_imageSavedNotInTemp(false)
     , m_saveImage(QImage())
     , m_tempFile(QUrl())
+    , m_encodedImageCache(std::make_shared<EncodedImageCache>())
 {
     connect(this, &ExportManager::imageExported, this, [](Actions actions, const QUrl &url) {
         if (actions & AnySave) {
@@ -60,7 +74,12 @@ ExportManager::ExportManager(QObject *parent)
     });
 }
 
-ExportManager::~ExportManager() = default;
+ExportManager::~ExportManager()
+{
+    if (m_backgroundEncodeCanceled) {
+        *m_backgroundEncodeCanceled = true;
+    }
+}
 
 ExportManager *ExportManager::instance()
 {
@@ -80,6 +99,8 @@ QImage ExportManager::image() const
 void ExportManager::setImage(const QImage &image)
 {
     m_saveImage = image;
+    m_encodedImageCache->reset(image.cacheKey());
+    startBackgroundEncode();
 
     // reset our saved tempfile
     if (m_tempFile.isValid()) {
@@ -252,57 +273,243 @@ inline static void removePlaceholderAndSeparators(const QString &placeholder, QS
     string.remove(placeholder);
 }
 
-QString ExportManager::formattedFilename(const QString &nameTemplate, const QDateTime &timestamp, const QString &windowTitle, const QUrl &saveLocation)
+/**
+ * A filename template parsed into literal text and placeholder tokens.
+ *
+ * Templates rarely change, so they are parsed once and cached. Formatting a filename then
+ * only has to walk the token list instead of searching the whole string for every placeholder.
+ */
+class FilenameTemplate
 {
-    if (nameTemplate.isEmpty()) {
-        return u"Screenshot"_s;
+public:
+    enum class TokenType {
+        Text,
+        Title,
+        DateTime,
+        Hour,
+        PaddedHour,
+        UnixTime,
+    };
+
+    struct Token {
+        TokenType type;
+        QString text; //< Literal text or the placeholder token itself.
+        qsizetype placeholder = -1; //< Index in ExportManager::filenamePlaceholders.
+    };
+
+    struct Program {
+        QList<Token> tokens;
+        bool hasSequence = false;
+    };
+
+    static std::shared_ptr<const FilenameTemplate> get(const QString &nameTemplate)
+    {
+        static QMutex mutex;
+        static QHash<QString, std::shared_ptr<const FilenameTemplate>> cache;
+        QMutexLocker locker(&mutex);
+        auto it = cache.constFind(nameTemplate);
+        if (it != cache.cend()) {
+            return it.value();
+        }
+        // Only a handful of templates are used at once. Don't let the cache grow forever.
+        if (cache.size() >= 32) {
+            cache.clear();
+        }
+        auto compiled = std::make_shared<const FilenameTemplate>(nameTemplate);
+        cache.insert(nameTemplate, compiled);
+        return compiled;
     }
-    QString result = nameTemplate;
-    QString baseDir = saveLocation.isValid() ? ensureDefaultLocationExists(saveLocation) : QString{};
 
-    if (!windowTitle.isEmpty()) {
-        QString title = windowTitle;
-        title.replace(u'/', u'_'); // POSIX doesn't allow "/" in filenames
-        result.replace("<title>"_L1, title);
-    } else {
-        removePlaceholderAndSeparators(u"<title>"_s, result);
+    explicit FilenameTemplate(const QString &nameTemplate)
+        : m_withTitle(compile(prepare(nameTemplate, true, true)))
+        , m_withoutTitle(compile(prepare(nameTemplate, false, true)))
+        , m_withTitleNoTimeZone(compile(prepare(nameTemplate, true, false)))
+        , m_withoutTitleNoTimeZone(compile(prepare(nameTemplate, false, false)))
+    {
     }
 
-    // Remove duplicate dir separators.
-    // These could come from user mistakes or empty placeholders being removed.
-    result.replace(QRegularExpression(u"/+"_s), u"/"_s);
+    const Program &program(bool hasTitle, bool hasTimeZone) const
+    {
+        if (hasTimeZone) {
+            return hasTitle ? m_withTitle : m_withoutTitle;
+        }
+        return hasTitle ? m_withTitleNoTimeZone : m_withoutTitleNoTimeZone;
+    }
 
-    if (timestamp.isValid()) {
+    static QString format(const Program &program, const QDateTime &timestamp, const QString &windowTitle)
+    {
         const auto &locale = QLocale::system();
-        // QDateTime can still be valid when timezone is invalid.
-        const bool validTimeZone = timestamp.timeZone().isValid();
-        for (auto it = filenamePlaceholders.cbegin(); it != filenamePlaceholders.cend(); ++it) {
-            if (it->flags.testFlags(Placeholder::IsQDateTime)) {
-                int tCount = 0;
-                // KDE BUG: https://bugs.kde.org/show_bug.cgi?id=493191
-                // QT BUG: https://bugreports.qt.io/browse/QTBUG-129696
-                // QCalendarBackend::dateTimeToString crashes when timezone is
-                // unset and we try to use the timezone.
-                if (!validTimeZone && (tCount = it->base.count(u't')) && tCount == it->base.size()) {
-                    removePlaceholderAndSeparators(it->token, result);
+        const auto &placeholders = ExportManager::filenamePlaceholders;
+        // Each placeholder is formatted at most once, even if it's used multiple times.
+        QVarLengthArray<QString, 40> formatted(placeholders.size());
+        auto formatOnce = [&](const Token &token, auto &&function) -> const QString & {
+            auto &value = formatted[token.placeholder];
+            if (value.isNull()) {
+                value = function();
+            }
+            return value;
+        };
+        QString title;
+        QString result;
+        for (const auto &token : program.tokens) {
+            if (token.type == TokenType::Text) {
+                result += token.text;
+            } else if (token.type == TokenType::Title) {
+                if (title.isNull()) {
+                    title = windowTitle;
+                    title.replace(u'/', u'_'); // POSIX doesn't allow "/" in filenames
+                }
+                result += title;
+            } else if (!timestamp.isValid()) {
+                result += token.text;
+            } else if (token.type == TokenType::DateTime) {
+                result += formatOnce(token, [&] {
+                    return locale.toString(timestamp, placeholders[token.placeholder].base);
+                });
+            } else if (token.type == TokenType::Hour) {
+                // `h` and `hh` in QDateTime::toString or QLocale::toString
+                // are only 12 hour when paired with an AM/PM display in the same toString call,
+                // so we have to get the 12 hour format for `<h>` and `<hh>` manually.
+                result += formatOnce(token, [&] {
+                    return timestamp.toString(u"hAP"_s).chopped(2);
+                });
+            } else if (token.type == TokenType::PaddedHour) {
+                result += formatOnce(token, [&] {
+                    return timestamp.toString(u"hhAP"_s).chopped(2);
+                });
+            } else if (token.type == TokenType::UnixTime) {
+                result += formatOnce(token, [&] {
+                    return QString::number(timestamp.toSecsSinceEpoch());
+                });
+            }
+        }
+        return result;
+    }
+
+private:
+    // Remove the placeholders that have no value, along with their separators.
+    static QString prepare(const QString &nameTemplate, bool hasTitle, bool hasTimeZone)
+    {
+        QString result = nameTemplate;
+        if (!hasTitle) {
+            removePlaceholderAndSeparators(u"<title>"_s, result);
+        }
+
+        // Remove duplicate dir separators.
+        // These could come from user mistakes or empty placeholders being removed.
+        static const QRegularExpression dirSeparators(u"/+"_s);
+        result.replace(dirSeparators, u"/"_s);
+
+        if (!hasTimeZone) {
+            // KDE BUG: https://bugs.kde.org/show_bug.cgi?id=493191
+            // QT BUG: https://bugreports.qt.io/browse/QTBUG-129696
+            // QCalendarBackend::dateTimeToString crashes when timezone is
+            // unset and we try to use the timezone.
+            for (const auto &placeholder : ExportManager::filenamePlaceholders) {
+                if (placeholder.flags.testFlag(ExportManager::Placeholder::IsQDateTime) && placeholder.base.count(u't') == placeholder.base.size()) {
+                    removePlaceholderAndSeparators(placeholder.token, result);
+                }
+            }
+        }
+        return result;
+    }
+
+    static Program compile(const QString &string)
+    {
+        const auto &placeholders = ExportManager::filenamePlaceholders;
+        Program program;
+        auto addText = [&program](QStringView text) {
+            if (text.isEmpty()) {
+                return;
+            }
+            if (!program.tokens.isEmpty() && program.tokens.constLast().type == TokenType::Text) {
+                program.tokens.last().text += text;
+            } else {
+                program.tokens.append({TokenType::Text, text.toString()});
+            }
+        };
+
+        qsizetype position = 0;
+        while (position < string.size()) {
+            const auto close = string.indexOf(u'>', position);
+            if (close < 0) {
+                addText(QStringView(string).sliced(position));
+                break;
+            }
+            // The innermost pair of brackets is the token, like with QString::replace().
+            const auto open = string.lastIndexOf(u'<', close);
+            if (open < position) {
+                addText(QStringView(string).sliced(position, close + 1 - position));
+                position = close + 1;
+                continue;
+            }
+            addText(QStringView(string).sliced(position, open - position));
+            position = close + 1;
+            const auto token = QStringView(string).sliced(open, close - open + 1);
+            const auto key = token.sliced(1, token.size() - 2);
+
+            if (!key.isEmpty() && std::all_of(key.cbegin(), key.cend(), [](QChar c) {
+                    return c == u'#';
+                })) {
+                // Sequence numbers are filled in afterwards because they depend on the rest of the filename.
+                program.hasSequence = true;
+                if (!program.tokens.isEmpty() && program.tokens.constLast().type == TokenType::Text) {
+                    program.tokens.last().text += token;
                 } else {
-                    result.replace(it->token, locale.toString(timestamp, it->base));
+                    program.tokens.append({TokenType::Text, token.toString()});
                 }
+                continue;
+            }
+            if (key == "title"_L1) {
+                program.tokens.append({TokenType::Title, token.toString()});
+                continue;
+            }
+            const auto it = std::find_if(placeholders.cbegin(), placeholders.cend(), [key](const ExportManager::Placeholder &placeholder) {
+                return placeholder.base == key;
+            });
+            const auto index = std::distance(placeholders.cbegin(), it);
+            if (it == placeholders.cend()) {
+                addText(token);
+            } else if (it->flags.testFlag(ExportManager::Placeholder::IsQDateTime)) {
+                program.tokens.append({TokenType::DateTime, token.toString(), index});
+            } else if (key == "h"_L1) {
+                program.tokens.append({TokenType::Hour, token.toString(), index});
+            } else if (key == "hh"_L1) {
+                program.tokens.append({TokenType::PaddedHour, token.toString(), index});
+            } else if (key == "UnixTime"_L1) {
+                program.tokens.append({TokenType::UnixTime, token.toString(), index});
+            } else {
+                addText(token);
             }
         }
-        // Manual interpretation
-        // `h` and `hh` in QDateTime::toString or QLocale::toString
-        // are only 12 hour when paired with an AM/PM display in the same toString call,
-        // so we have to get the 12 hour format for `<h>` and `<hh>` manually.
-        result.replace("<h>"_L1, timestamp.toString(u"hAP"_s).chopped(2));
-        result.replace("<hh>"_L1, timestamp.toString(u"hhAP"_s).chopped(2));
-        result.replace("<UnixTime>"_L1, QString::number(timestamp.toSecsSinceEpoch()));
+        return program;
+    }
+
+    Program m_withTitle;
+    Program m_withoutTitle;
+    Program m_withTitleNoTimeZone;
+    Program m_withoutTitleNoTimeZone;
+};
+
+QString ExportManager::formattedFilename(const QString &nameTemplate, const QDateTime &timestamp, const QString &windowTitle, const QUrl &saveLocation)
+{
+    if (nameTemplate.isEmpty()) {
+        return u"Screenshot"_s;
     }
+    QString baseDir = saveLocation.isValid() ? ensureDefaultLocationExists(saveLocation) : QString{};
+
+    const auto compiledTemplate = FilenameTemplate::get(nameTemplate);
+    // QDateTime can still be valid when timezone is invalid.
+    const bool hasTimeZone = !timestamp.isValid() || timestamp.timeZone().isValid();
+    const auto &program = compiledTemplate->program(!windowTitle.isEmpty(), hasTimeZone);
+    QString result = FilenameTemplate::format(program, timestamp, windowTitle);
 
     // check if basename includes %[N]d token for sequential file numbering
-    QRegularExpression paddingRE;
-    paddingRE.setPattern(u"<(#+)>"_s);
-    QRegularExpressionMatchIterator it = paddingRE.globalMatch(result);
+    static const QRegularExpression paddingRE(u"<(#+)>"_s);
+    QRegularExpressionMatchIterator it;
+    if (program.hasSequence) {
+        it = paddingRE.globalMatch(result);
+    }
     if (it.hasNext()) {
         // strip any subdirectories from the template to construct the filename matching regex
         // we are matching filenames only, not paths
@@ -325,28 +532,9 @@ QString ExportManager::formattedFilename(const QString &nameTemplate, const QDat
             // so let's add that to baseDir before we search for files.
             baseDir += u"/%1"_s.arg(result.section(u'/', 0, -2));
         }
-        // search save directory for files
-        QDir dir(baseDir);
-        const QStringList fileNames = dir.entryList(QDir::Files, QDir::Name);
-        int highestFileNumber = 0;
-
-        // if there are files in the directory...
-        if (fileNames.length() > 0) {
-            QRegularExpression fileNumberRE;
-            fileNumberRE.setPattern(resultCopy);
-            // ... check the file names for string matching token with padding specified in result
-            const QStringList filteredFiles = fileNames.filter(fileNumberRE);
-            // if there are files in the directory that look like the file name with sequential numbering
-            if (filteredFiles.length() > 0) {
-                // loop through filtered file names looking for highest number
-                for (const QString &filteredFile : filteredFiles) {
-                    int currentFileNumber = fileNumberRE.match(filteredFile).captured(1).toInt();
-                    if (currentFileNumber > highestFileNumber) {
-                        highestFileNumber = currentFileNumber;
-                    }
-                }
-            }
-        }
+        // find the highest number of the files in the save directory that match the template.
+        // The index only scans the directory the first time, then keeps the number up to date.
+        const int highestFileNumber = DirectoryIndex::instance()->highestNumber(baseDir, resultCopy);
         // replace placeholder with next number padded
         for (const auto &match : matches) {
             int paddedLength = 1;
@@ -440,18 +628,15 @@ QImage scaledImageFromSubGeometry(const QImage &image)
                              fastScale ? Qt::FastTransformation : Qt::SmoothTransformation);
 }
 
-bool ExportManager::writeImage(QIODevice *device, const QByteArray &suffix, QByteArrayView encodedImage)
+// Encodes an image like QImageWriter would write it to a file with the given suffix.
+static bool encodeImage(QIODevice *device, const QImage &image, const QByteArray &suffix, int quality, QString *errorString)
 {
-    if (!encodedImage.isNull()) {
-        return device->write(encodedImage.data(), encodedImage.size()) == encodedImage.size();
-    }
-
     // In the documentation for QImageWriter, it is a bit ambiguous what "format" means.
     // From looking at how QImageWriter handles the built-in supported formats internally,
     // "format" basically means the file extension, not the mimetype.
     QImageWriter imageWriter(device, suffix);
     if (imageWriter.supportsOption(QImageIOHandler::Quality)) {
-        imageWriter.setQuality(Settings::imageCompressionQuality());
+        imageWriter.setQuality(quality);
     }
     /** Set compression 50 if the format is png. Otherwise if no compression value is specified
      *  it will fallback to using quality (QTBUG-43618) and produce huge files.
@@ -463,82 +648,516 @@ bool ExportManager::writeImage(QIODevice *device, const QByteArray &suffix, QByt
         imageWriter.setCompression(50);
     }
     if (!(imageWriter.canWrite())) {
-        Q_EMIT errorMessage(i18nc("%1 is an error message", "QImageWriter cannot write image: %1", imageWriter.errorString()));
+        if (errorString) {
+            *errorString = i18nc("%1 is an error message", "QImageWriter cannot write image: %1", imageWriter.errorString());
+        }
+        return false;
+    }
+    return imageWriter.write(image);
+}
+
+/**
+ * Encoded versions of the current image, so that saving, copying, dragging and sharing
+ * the same image only encodes it once per format. Used from worker threads.
+ */
+class ExportManager::EncodedImageCache
+{
+public:
+    /**
+     * Returns the cached data. If another thread is encoding the same data, this waits for it.
+     *
+     * If nothing is cached, the caller is responsible for encoding the data
+     * and must call insert() afterwards, with empty data if encoding failed.
+     */
+    QByteArray value(qint64 cacheKey, const QByteArray &format, int quality)
+    {
+        QMutexLocker locker(&m_mutex);
+        const Key key{cacheKey, format, quality};
+        while (m_encoding.contains(key)) {
+            m_encodingFinished.wait(&m_mutex);
+        }
+        auto data = m_data.value(key);
+        if (data.isEmpty()) {
+            m_encoding.insert(key);
+        }
+        return data;
+    }
+
+    void insert(qint64 cacheKey, const QByteArray &format, int quality, const QByteArray &data)
+    {
+        QMutexLocker locker(&m_mutex);
+        const Key key{cacheKey, format, quality};
+        // Don't keep data for images that were replaced while they were being encoded.
+        if (cacheKey == m_cacheKey && !data.isEmpty()) {
+            m_data.insert(key, data);
+        }
+        m_encoding.remove(key);
+        m_encodingFinished.wakeAll();
+    }
+
+    void reset(qint64 cacheKey)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_cacheKey = cacheKey;
+        m_data.clear();
+    }
+
+private:
+    struct Key {
+        qint64 cacheKey;
+        QByteArray format;
+        int quality;
+        bool operator==(const Key &other) const = default;
+        friend size_t qHash(const Key &key, size_t seed = 0)
+        {
+            return qHashMulti(seed, key.cacheKey, key.format, key.quality);
+        }
+    };
+    QMutex m_mutex;
+    QWaitCondition m_encodingFinished;
+    qint64 m_cacheKey = 0;
+    QHash<Key, QByteArray> m_data;
+    QSet<Key> m_encoding;
+};
+
+// Returns the image encoded in the given format, from the cache if possible.
+static QByteArray cachedEncodedImage(ExportManager::EncodedImageCache &cache, const QImage &image, const QByteArray &format, int quality,
+                                     const std::atomic_bool &canceled, QString *errorString);
+
+bool ExportManager::writeImage(QIODevice *device, const QByteArray &suffix, QByteArrayView encodedImage)
+{
+    if (!encodedImage.isNull()) {
+        return device->write(encodedImage.data(), encodedImage.size()) == encodedImage.size();
+    }
+
+    QString errorString;
+    const std::atomic_bool canceled = false;
+    const auto data = cachedEncodedImage(*m_encodedImageCache, m_saveImage, suffix, Settings::imageCompressionQuality(), canceled, &errorString);
+    if (data.isEmpty()) {
+        if (!errorString.isEmpty()) {
+            Q_EMIT errorMessage(errorString);
+        }
+        return false;
+    }
+    return device->write(data) == data.size();
+}
+
+/**
+ * Encoded image data that is uploaded while the image is still being encoded.
+ *
+ * The encoder appends data on a worker thread and the upload job reads it in chunks on the GUI thread.
+ * All of the data is kept so that the upload can be restarted and the result can be cached.
+ */
+class UploadBuffer
+{
+public:
+    enum Status {
+        HasData,
+        Waiting,
+        Finished,
+        Failed,
+    };
+
+    /**
+     * Reads the next chunk of data. Returns Waiting if the encoder hasn't written it yet,
+     * in which case the function given to setWakeUp() is called once it has.
+     */
+    Status read(QByteArray *chunk)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_readPosition < m_data.size()) {
+            // KIO recommends passing at most 1 MiB at a time.
+            constexpr qsizetype maxChunkSize = 1024 * 1024;
+            *chunk = m_data.sliced(m_readPosition, std::min(maxChunkSize, m_data.size() - m_readPosition));
+            m_readPosition += chunk->size();
+            return HasData;
+        }
+        if (m_finished) {
+            return m_failed ? Failed : Finished;
+        }
+        m_waiting = true;
+        return Waiting;
+    }
+
+    // Start reading from the beginning again.
+    void rewind()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_readPosition = 0;
+        m_waiting = false;
+    }
+
+    // The function is called with context's thread affinity.
+    void setWakeUp(QObject *context, const std::function<void()> &wakeUp)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_context = context;
+        m_wakeUp = wakeUp;
+    }
+
+    void append(const char *data, qint64 length)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_data.append(data, length);
+        wakeUp();
+    }
+
+    void finish(bool success)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_finished = true;
+        m_failed = !success;
+        wakeUp();
+    }
+
+    QByteArray data() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_data;
+    }
+
+private:
+    void wakeUp()
+    {
+        if (m_waiting && m_context) {
+            m_waiting = false;
+            QMetaObject::invokeMethod(m_context, m_wakeUp, Qt::QueuedConnection);
+        }
+    }
+
+    mutable QMutex m_mutex;
+    QByteArray m_data;
+    qsizetype m_readPosition = 0;
+    bool m_waiting = false;
+    bool m_finished = false;
+    bool m_failed = false;
+    QObject *m_context = nullptr;
+    std::function<void()> m_wakeUp;
+};
+
+void ExportManager::startBackgroundEncode()
+{
+    // The image changed, so the result of the last background encode wouldn't be used.
+    if (m_backgroundEncodeCanceled) {
+        *m_backgroundEncodeCanceled = true;
+        m_backgroundEncodeCanceled.reset();
+    }
+    if (!Settings::encodeImageInBackground() || m_saveImage.isNull()) {
+        return;
+    }
+    // Encode in the format that saving and copying use by default, so that they can use the cached data
+    // or wait for the encode that's already running instead of starting from scratch.
+    auto canceled = std::make_shared<std::atomic_bool>(false);
+    m_backgroundEncodeCanceled = canceled;
+    const auto format = Settings::preferredImageFormat().toLower().toLatin1();
+    const int quality = Settings::imageCompressionQuality();
+    auto future = QtConcurrent::run([cache = m_encodedImageCache, image = m_saveImage, format, quality, canceled] {
+        QElapsedTimer timer;
+        timer.start();
+        const auto data = cachedEncodedImage(*cache, image, format, quality, *canceled, nullptr);
+        Log::debug() << "Background encode" << (data.isEmpty() ? "canceled or failed" : "done") << "after" << timer.elapsed() << "ms";
+    });
+}
+
+/**
+ * The state of an export that is shared with the threads and jobs working on it.
+ */
+struct ExportManager::ExportJob {
+    std::atomic_bool canceled = false;
+    QPointer<KJob> kioJob;
+    QImage image;
+    QUrl saveUrl;
+    QByteArray clipboardFormat;
+    int quality = -1;
+    // Remote saves upload the image while it's being encoded.
+    std::shared_ptr<UploadBuffer> upload;
+    std::optional<bool> uploaded;
+    std::optional<ExportResult> encodeResult;
+    // Exports are finished even if the last window closes while they are running.
+    QEventLoopLocker eventLoopLocker;
+};
+
+/**
+ * A buffer that fails writes once the export is canceled, so that QImageWriter stops encoding.
+ */
+class CancelableBuffer : public QBuffer
+{
+public:
+    CancelableBuffer(QByteArray *data, const std::atomic_bool &canceled)
+        : QBuffer(data)
+        , m_canceled(canceled)
+    {
+    }
+
+protected:
+    qint64 writeData(const char *data, qint64 length) override
+    {
+        if (m_canceled) {
+            return -1;
+        }
+        return QBuffer::writeData(data, length);
+    }
+
+private:
+    const std::atomic_bool &m_canceled;
+};
+
+static bool encodeImageData(QByteArray &data, const QImage &image, const QByteArray &suffix, int quality, const std::atomic_bool &canceled, QString *errorString)
+{
+    CancelableBuffer buffer(&data, canceled);
+    if (!buffer.open(QIODevice::WriteOnly)) {
         return false;
     }
+    return encodeImage(&buffer, image, suffix, quality, errorString) && !canceled;
+}
+
+static QByteArray cachedEncodedImage(ExportManager::EncodedImageCache &cache, const QImage &image, const QByteArray &format, int quality,
+                                     const std::atomic_bool &canceled, QString *errorString)
+{
+    auto data = cache.value(image.cacheKey(), format, quality);
+    if (!data.isEmpty()) {
+        return data;
+    }
     // Scale image to original scale if possible.
     // This is done here because we need the highest resolution version in the rest of the app.
-    return imageWriter.write(scaledImageFromSubGeometry(m_saveImage));
+    if (!encodeImageData(data, scaledImageFromSubGeometry(image), format, quality, canceled, errorString)) {
+        data.clear();
+    }
+    cache.insert(image.cacheKey(), format, quality, data);
+    return data;
+}
+
+/**
+ * A write-only device that passes everything the encoder writes on to an upload.
+ */
+class UploadDevice : public QIODevice
+{
+public:
+    UploadDevice(UploadBuffer &upload, const std::atomic_bool &canceled)
+        : m_upload(upload)
+        , m_canceled(canceled)
+    {
+    }
+
+protected:
+    qint64 readData(char *, qint64) override
+    {
+        return -1;
+    }
+
+    qint64 writeData(const char *data, qint64 length) override
+    {
+        if (m_canceled) {
+            return -1;
+        }
+        m_upload.append(data, length);
+        return length;
+    }
+
+private:
+    UploadBuffer &m_upload;
+    const std::atomic_bool &m_canceled;
+};
+
+// Like cachedEncodedImage(), but the data is also given to the upload while it's being encoded.
+static QByteArray uploadEncodedImage(ExportManager::EncodedImageCache &cache, UploadBuffer &upload, const QImage &image, const QByteArray &format, int quality,
+                                     const std::atomic_bool &canceled, QString *errorString)
+{
+    auto data = cache.value(image.cacheKey(), format, quality);
+    if (!data.isEmpty()) {
+        upload.append(data.constData(), data.size());
+    } else {
+        UploadDevice device(upload, canceled);
+        device.open(QIODevice::WriteOnly);
+        if (encodeImage(&device, scaledImageFromSubGeometry(image), format, quality, errorString) && !canceled) {
+            data = upload.data();
+        }
+        cache.insert(image.cacheKey(), format, quality, data);
+    }
+    upload.finish(!data.isEmpty());
+    return data;
 }
 
-bool ExportManager::localSave(const QUrl &url, const QString &suffix, QByteArrayView encodedImage)
+/**
+ * Clipboard data for an image that only encodes the image when a paste target asks for a format.
+ * Each format is encoded at most once.
+ */
+class ImageMimeData : public QMimeData
+{
+public:
+    ImageMimeData(const QImage &image,
+                  const QString &preferredMimeType,
+                  const QByteArray &preferredFormat,
+                  int quality,
+                  const std::shared_ptr<ExportManager::EncodedImageCache> &cache)
+        : m_image(image)
+        , m_preferredMimeType(preferredMimeType)
+        , m_preferredFormat(preferredFormat)
+        , m_quality(quality)
+        , m_cache(cache)
+    {
+    }
+
+    QStringList formats() const override
+    {
+        // The preferred format is first so that it gets chosen first.
+        QStringList formats{m_preferredMimeType};
+        if (m_preferredMimeType != "image/png"_L1) {
+            formats << u"image/png"_s;
+        }
+        // Lets Qt and Klipper get the uncompressed image, and exposes all the other image formats.
+        formats << u"application/x-qt-image"_s;
+        formats << QMimeData::formats();
+        return formats;
+    }
+
+protected:
+    QVariant retrieveData(const QString &mimeType, QMetaType type) const override
+    {
+        QMutexLocker locker(&m_mutex);
+        if (mimeType == "application/x-qt-image"_L1) {
+            if (m_scaledImage.isNull()) {
+                m_scaledImage = scaledImageFromSubGeometry(m_image);
+            }
+            return m_scaledImage;
+        }
+
+        QByteArray format;
+        if (mimeType == m_preferredMimeType) {
+            format = m_preferredFormat;
+        } else if (mimeType == "image/png"_L1) {
+            format = "png"_ba;
+        } else {
+            return QMimeData::retrieveData(mimeType, type);
+        }
+        auto it = m_encodedData.constFind(mimeType);
+        if (it == m_encodedData.cend()) {
+            const std::atomic_bool canceled = false;
+            it = m_encodedData.insert(mimeType, cachedEncodedImage(*m_cache, m_image, format, m_quality, canceled, nullptr));
+        }
+        return it.value();
+    }
+
+private:
+    const QImage m_image;
+    const QString m_preferredMimeType;
+    const QByteArray m_preferredFormat;
+    const int m_quality;
+    const std::shared_ptr<ExportManager::EncodedImageCache> m_cache;
+    mutable QMutex m_mutex;
+    mutable QImage m_scaledImage;
+    mutable QHash<QString, QByteArray> m_encodedData;
+};
+
+static bool localSave(const QUrl &url, QByteArrayView encodedImage, const std::atomic_bool &canceled, QString *errorString)
 {
     // Create save directory if it doesn't exist
     const QUrl dirPath(url.adjusted(QUrl::RemoveFilename));
     const QDir dir(dirPath.path());
 
     if (!dir.mkpath(u"."_s)) {
-        Q_EMIT errorMessage(xi18nc("@info",
-                                   "Cannot save screenshot because creating "
-                                   "the directory failed:<nl/><filename>%1</filename>",
-                                   dirPath.path()));
+        *errorString = xi18nc("@info",
+                              "Cannot save screenshot because creating "
+                              "the directory failed:<nl/><filename>%1</filename>",
+                              dirPath.path());
         return false;
     }
 
     QSaveFile outputFile(url.toLocalFile());
 
     if (!outputFile.open(QFile::WriteOnly)) {
-        Q_EMIT errorMessage(i18n("Cannot save screenshot. Error while opening file."));
+        *errorString = i18n("Cannot save screenshot. Error while opening file.");
         return false;
     }
-    if (!writeImage(&outputFile, suffix.toLatin1(), encodedImage) || !outputFile.commit()) {
-        Q_EMIT errorMessage(i18n("Cannot save screenshot. Error while writing file."));
+    if (outputFile.write(encodedImage.data(), encodedImage.size()) != encodedImage.size()) {
+        *errorString = i18n("Cannot save screenshot. Error while writing file.");
+        return false;
+    }
+    if (canceled) {
+        outputFile.cancelWriting();
+        return false;
+    }
+    if (!outputFile.commit()) {
+        *errorString = i18n("Cannot save screenshot. Error while writing file.");
         return false;
     }
     return true;
 }
 
-bool ExportManager::remoteSave(const QUrl &url, const QString &suffix, QByteArrayView encodedImage)
+void ExportManager::remoteSave(const std::shared_ptr<ExportJob> &job, bool createdDirectory, std::function<void(bool)> done)
 {
-    // Check if remote save directory exists
+    const QUrl url = job->saveUrl;
     const QUrl dirPath(url.adjusted(QUrl::RemoveFilename));
-    KIO::ListJob *listJob = KIO::listDir(dirPath);
-    listJob->exec();
-
-    if (listJob->error() != KJob::NoError) {
-        // Create remote save directory
-        KIO::MkpathJob *mkpathJob = KIO::mkpath(dirPath, QUrl(defaultSaveLocation()));
-        mkpathJob->exec();
 
-        if (mkpathJob->error() != KJob::NoError) {
-            Q_EMIT errorMessage(xi18nc("@info",
-                                       "Cannot save screenshot because creating the "
-                                       "remote directory failed:<nl/><filename>%1</filename>",
-                                       dirPath.path()));
-            return false;
-        }
+    // Progress is shown by the job tracker. The total size is set once encoding is done.
+    auto uploadJob = KIO::put(url, -1);
+    uploadJob->setAsyncDataEnabled(true);
+    job->kioJob = uploadJob;
+    job->upload->rewind();
+    if (job->encodeResult) {
+        uploadJob->setTotalSize(job->encodeResult->savedImageData.size());
     }
 
-    QTemporaryFile tmpFile;
-
-    if (tmpFile.open()) {
-        if (!writeImage(&tmpFile, suffix.toLatin1(), encodedImage) || !tmpFile.flush()) {
-            Q_EMIT errorMessage(i18n("Cannot save screenshot. Error while writing temporary local file."));
-            return false;
+    auto sendData = [job, uploadJob = QPointer<KIO::TransferJob>(uploadJob)] {
+        if (!uploadJob || job->kioJob != uploadJob) {
+            return;
         }
-        tmpFile.close();
-
-        KIO::FileCopyJob *uploadJob = KIO::file_copy(QUrl::fromLocalFile(tmpFile.fileName()), url);
-        uploadJob->exec();
+        QByteArray chunk;
+        switch (job->upload->read(&chunk)) {
+        case UploadBuffer::HasData:
+            uploadJob->sendAsyncData(chunk);
+            break;
+        case UploadBuffer::Finished:
+            // An empty chunk ends the upload.
+            uploadJob->sendAsyncData({});
+            break;
+        case UploadBuffer::Waiting:
+        case UploadBuffer::Failed:
+            // The job is killed when the encoding result arrives.
+            break;
+        }
+    };
+    job->upload->setWakeUp(this, sendData);
+    connect(uploadJob, &KIO::TransferJob::dataReq, this, [sendData](KIO::Job *, QByteArray &) {
+        sendData();
+    });
 
-        if (uploadJob->error() != KJob::NoError) {
+    connect(uploadJob, &KJob::result, this, [this, job, dirPath, createdDirectory, done](KJob *uploadJob) {
+        job->kioJob = nullptr;
+        if (job->canceled) {
+            done(false);
+            return;
+        }
+        if (uploadJob->error() == KJob::NoError) {
+            done(true);
+            return;
+        }
+        if (createdDirectory || uploadJob->error() == KIO::ERR_FILE_ALREADY_EXIST) {
+            Log::debug() << "Upload failed:" << uploadJob->errorString();
             Q_EMIT errorMessage(i18n("Unable to save image. Could not upload file to remote location."));
-            return false;
+            done(false);
+            return;
         }
-        return true;
-    }
-
-    return false;
+        // The save directory usually exists, so it's only created after the upload fails.
+        auto mkpathJob = KIO::mkpath(dirPath, QUrl(defaultSaveLocation()));
+        job->kioJob = mkpathJob;
+        connect(mkpathJob, &KJob::result, this, [this, job, dirPath, done](KJob *mkpathJob) {
+            job->kioJob = nullptr;
+            if (job->canceled) {
+                done(false);
+                return;
+            }
+            if (mkpathJob->error() != KJob::NoError) {
+                Q_EMIT errorMessage(xi18nc("@info",
+                                           "Cannot save screenshot because creating the "
+                                           "remote directory failed:<nl/><filename>%1</filename>",
+                                           dirPath.path()));
+                done(false);
+                return;
+            }
+            remoteSave(job, true, done);
+        });
+    });
 }
 
 QUrl ExportManager::tempSave()
@@ -577,58 +1196,72 @@ QUrl ExportManager::tempSave()
     return QUrl();
 }
 
-bool ExportManager::save(const QUrl &url, QByteArrayView encodedImage)
+bool ExportManager::isFileExists(const QUrl &url) const
 {
     if (!(url.isValid())) {
-        Q_EMIT errorMessage(i18n("Cannot save screenshot. The save filename is invalid."));
         return false;
     }
-
-    const QString suffix = imageFileSuffix(url);
-    bool saveSucceded = false;
-    if (url.isLocalFile()) {
-        saveSucceded = localSave(url, suffix, encodedImage);
-    } else {
-        saveSucceded = remoteSave(url, suffix, encodedImage);
-    }
-    if (saveSucceded) {
-        m_imageSavedNotInTemp = true;
-        KRecentDocument::add(url, QGuiApplication::desktopFileName());
+    // Files that are still being exported will exist soon.
+    for (const auto &job : m_exportJobs) {
+        if (job->saveUrl == url) {
+            return true;
+        }
     }
-    return saveSucceded;
+    // The index lists each directory once, locally or through KIO, instead of a stat job per URL.
+    return DirectoryIndex::instance()->contains(url);
 }
 
-bool ExportManager::isFileExists(const QUrl &url) const
+bool ExportManager::isImageSavedNotInTemp() const
 {
-    if (!(url.isValid())) {
-        return false;
-    }
-    // Using StatJob instead of QFileInfo::exists() is necessary for checking non-local URLs.
-    KIO::StatJob *existsJob = KIO::stat(url, KIO::StatJob::DestinationSide, KIO::StatNoDetails, KIO::HideProgressInfo);
+    return m_imageSavedNotInTemp;
+}
 
-    existsJob->exec();
+bool ExportManager::isTempFileAlreadyUsed(const QUrl &url) const
+{
+    return m_usedTempFileNames.contains(url);
+}
 
-    return (existsJob->error() == KJob::NoError);
+bool ExportManager::isExporting() const
+{
+    return !m_exportJobs.isEmpty();
 }
 
-bool ExportManager::isImageSavedNotInTemp() const
+QUrl ExportManager::pendingSaveUrl() const
 {
-    return m_imageSavedNotInTemp;
+    // The newest export is the one that ends up in the file.
+    for (auto it = m_exportJobs.crbegin(); it != m_exportJobs.crend(); ++it) {
+        const auto &job = *it;
+        if (!job->canceled && !job->saveUrl.isEmpty() && job->image.cacheKey() == m_saveImage.cacheKey()) {
+            return job->saveUrl;
+        }
+    }
+    return {};
 }
 
-bool ExportManager::isTempFileAlreadyUsed(const QUrl &url) const
+void ExportManager::cancelExports(const QUrl &saveUrl)
 {
-    return m_usedTempFileNames.contains(url);
+    for (const auto &job : std::as_const(m_exportJobs)) {
+        if (job->saveUrl != saveUrl) {
+            continue;
+        }
+        Log::debug() << "Canceling superseded export to" << saveUrl;
+        job->canceled = true;
+        if (job->kioJob) {
+            job->kioJob->kill(KJob::EmitResult);
+        }
+    }
 }
 
 void ExportManager::exportImage(ExportManager::Actions actions, QUrl url)
 {
     if (m_saveImage.isNull() && actions & (Save | SaveAs | CopyImage)) {
         Q_EMIT errorMessage(i18n("Cannot save an empty screenshot image."));
+        if (actions & AnySave) {
+            Q_EMIT imageSaveFailed(url);
+        }
         return;
     }
 
-    bool success = false;
     if (actions & SaveAs) {
         QStringList supportedFilters;
 
@@ -676,28 +1309,126 @@ void ExportManager::exportImage(ExportManager::Actions actions, QUrl url)
         return;
     }
 
+    // Everything the export needs from the GUI thread is gathered here,
+    // so that encoding and writing can happen on a worker thread.
+    auto job = std::make_shared<ExportJob>();
+    const QImage image = m_saveImage;
     const auto preferredFormat = Settings::preferredImageFormat().toLower();
-    QByteArray sharedImageData;
-    bool hasSharedImageData = false;
-    bool saved = actions & AnySave;
-    if (saved) {
+    const int quality = Settings::imageCompressionQuality();
+    QString saveFormat;
+    // Encode the clipboard data like the saved file if the formats match, so it can be shared.
+    job->clipboardFormat = preferredFormat.toLatin1();
+    if (actions & AnySave) {
         if (!url.isValid()) {
             url = getAutosaveFilename();
         }
+        if (!url.isValid()) {
+            Q_EMIT errorMessage(i18n("Cannot save screenshot. The save filename is invalid."));
+            Q_EMIT imageSaveFailed(url);
+            actions.setFlag(Save, false);
+        } else {
+            // Otherwise an older export could finish last and overwrite the newer image.
+            cancelExports(url);
+            job->saveUrl = url;
+            saveFormat = imageFileSuffix(url);
+            const QString canonicalPreferredFormat =
+                QMimeDatabase().mimeTypeForFile(u"image."_s + preferredFormat, QMimeDatabase::MatchExtension).preferredSuffix();
+            if (saveFormat == preferredFormat || saveFormat == canonicalPreferredFormat) {
+                job->clipboardFormat = saveFormat.toLatin1();
+            }
+        }
+    }
+    const bool saveLocally = !job->saveUrl.isEmpty() && job->saveUrl.isLocalFile();
+    job->image = image;
+    job->quality = quality;
+    if (!job->saveUrl.isEmpty() && !saveLocally) {
+        job->upload = std::make_shared<UploadBuffer>();
+    }
+    m_exportJobs.append(job);
+
+    auto encode = [job, cache = m_encodedImageCache, image, quality, saveFormat, saveLocally] {
+        ExportResult result;
+        result.sourceCacheKey = image.cacheKey();
+        const auto &canceled = job->canceled;
+        if (!job->saveUrl.isEmpty()) {
+            if (job->upload) {
+                result.savedImageData = uploadEncodedImage(*cache, *job->upload, image, saveFormat.toLatin1(), quality, canceled, &result.errorString);
+            } else {
+                result.savedImageData = cachedEncodedImage(*cache, image, saveFormat.toLatin1(), quality, canceled, &result.errorString);
+            }
+            if (result.savedImageData.isEmpty()) {
+                if (result.errorString.isEmpty()) {
+                    result.errorString = i18n("Cannot save screenshot. Error while writing file.");
+                }
+            } else if (saveLocally) {
+                result.saved = localSave(job->saveUrl, result.savedImageData, canceled, &result.errorString);
+            }
+        }
+        return result;
+    };
 
-        const QString saveFormat = imageFileSuffix(url);
-        const QString canonicalPreferredFormat =
-            QMimeDatabase().mimeTypeForFile(u"image."_s + preferredFormat, QMimeDatabase::MatchExtension).preferredSuffix();
-        if (actions & CopyImage && (saveFormat == preferredFormat || saveFormat == canonicalPreferredFormat)) {
-            QBuffer buffer(&sharedImageData);
-            if (buffer.open(QIODevice::WriteOnly)) {
-                hasSharedImageData = writeImage(&buffer, saveFormat.toLatin1());
+    QtConcurrent::run(encode).then(this, [this, job, actions, url](ExportResult result) {
+        if (!job->upload) {
+            finishExport(job, actions, url, result);
+            return;
+        }
+        if (job->canceled || result.savedImageData.isEmpty()) {
+            // There is nothing left to upload.
+            if (job->kioJob) {
+                job->kioJob->kill();
             }
+            finishExport(job, actions, url, result);
+            return;
+        }
+        if (auto uploadJob = qobject_cast<KIO::TransferJob *>(job->kioJob)) {
+            uploadJob->setTotalSize(result.savedImageData.size());
+        }
+        if (!job->uploaded) {
+            // Wait for the upload to finish.
+            job->encodeResult = result;
+            return;
         }
+        result.saved = *job->uploaded;
+        finishExport(job, actions, url, result);
+    });
+
+    if (job->upload) {
+        // Start uploading right away, so that connecting to the server happens during encoding.
+        remoteSave(job, false, [this, job, actions, url](bool saved) {
+            job->uploaded = saved;
+            if (job->encodeResult) {
+                auto result = *job->encodeResult;
+                result.saved = saved;
+                finishExport(job, actions, url, result);
+            }
+        });
+    }
+}
 
-        const QByteArrayView encodedImage = hasSharedImageData ? QByteArrayView(sharedImageData) : QByteArrayView();
-        saved = success = save(url, encodedImage);
-        if (!success) {
+void ExportManager::finishExport(const std::shared_ptr<ExportJob> &job, Actions actions, QUrl url, const ExportResult &result)
+{
+    m_exportJobs.removeOne(job);
+    if (job->canceled) {
+        Log::debug() << "Export canceled:" << actions << url;
+        return;
+    }
+
+    bool success = false;
+    const bool saved = !job->saveUrl.isEmpty() && result.saved;
+    if (actions & AnySave) {
+        success = saved;
+        if (saved) {
+            // The image may have changed while the export was running.
+            if (result.sourceCacheKey == m_saveImage.cacheKey()) {
+                m_imageSavedNotInTemp = true;
+            }
+            KRecentDocument::add(url, QGuiApplication::desktopFileName());
+            DirectoryIndex::instance()->insert(url);
+        } else {
+            if (!result.errorString.isEmpty()) {
+                Q_EMIT errorMessage(result.errorString);
+            }
+            Q_EMIT imageSaveFailed(url);
             actions.setFlag(Save, false);
             actions.setFlag(SaveAs, false);
         }
@@ -707,31 +1438,15 @@ void ExportManager::exportImage(ExportManager::Actions actions, QUrl url)
         if (!url.isValid() && m_imageSavedNotInTemp) {
             url = Settings::self()->lastImageSaveLocation();
         }
-        auto data = new QMimeData();
+        const auto preferredFormat = Settings::preferredImageFormat().toLower();
         // TODO: Maybe copy a temp file URL instead? That way we could reliably
         // paste as the preferred format without decompression. The issue with
         // that is that some apps like Discord won't copy temp files when in a
         // Flatpak even if you use KUrlMimeData::exportUrlsToPortal().
-        auto image = scaledImageFromSubGeometry(m_saveImage);
-        QByteArray encodedImage;
-        if (hasSharedImageData) {
-            encodedImage = sharedImageData;
-        } else {
-            QBuffer buffer(&encodedImage);
-            buffer.open(QIODevice::WriteOnly);
-            QImageWriter writer(&buffer, preferredFormat.toLatin1());
-            if (preferredFormat != u"png" && writer.supportsOption(QImageIOHandler::Quality)) {
-                writer.setQuality(Settings::imageCompressionQuality());
-            }
-            writer.write(image);
-        }
-        // Set first so that it gets chosen first.
-        data->setData(u"image/" + preferredFormat, encodedImage);
-        // Use the standard way to set images to expose all the other formats.
-        // We use the uncompressed image because lossy compressed formats will
+        // We offer the uncompressed image too because lossy compressed formats will
         // decompress when turned into QImages and become 2-8x larger than their
-        // compressed size.
-        data->setImageData(image);
+        // compressed size. Nothing is encoded or converted until it is pasted.
+        auto data = new ImageMimeData(job->image, u"image/" + preferredFormat, job->clipboardFormat, job->quality, m_encodedImageCache);
         // "x-kde-force-image-copy" is handled by Klipper.
         // It ensures that the image is copied to Klipper even with the
         // "Non-text selection: Never save in history" setting selected in Klipper.
@@ -914,6 +1629,9 @@ void ExportManager::exportVideo(ExportManager::Actions actions, const QUrl &inpu
         copiedPath = true;
     }
 
+    if (saved) {
+        DirectoryIndex::instance()->insert(outputUrl);
+    }
     if (saved || copiedPath) {
         Q_EMIT videoExported(actions, outputUrl);
     }
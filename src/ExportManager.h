@@ -9,6 +9,7 @@
 #include <KLocalizedString>
 #include <QByteArrayView>
 #include <QDateTime>
+#include <QImage>
 class QLockFile;
 class QIODevice;
 #include <QMap>
@@ -16,6 +17,10 @@ class QIODevice;
 class QPrinter;
 #include <QUrl>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+
 class QTemporaryDir;
 
 class ExportManager : public QObject
@@ -117,11 +122,27 @@ public:
 
     static const QList<Placeholder> filenamePlaceholders;
 
+    class EncodedImageCache;
+
     /**
      * Export an image with the given actions using the given URL or an automatically generated URL.
+     *
+     * Encoding and saving happen in the background. imageExported() or errorMessage()
+     * is emitted when the export is done.
      */
     void exportImage(ExportManager::Actions actions, QUrl url = {});
 
+    /**
+     * Whether image exports are still being encoded or written.
+     */
+    bool isExporting() const;
+
+    /**
+     * The URL that a running export is saving the current image to, or an empty URL.
+     * imageExported() or imageSaveFailed() is emitted with it when the export is done.
+     */
+    QUrl pendingSaveUrl() const;
+
     /**
      * Export an video with the given actions using the given URL or an automatically generated URL.
      */
@@ -142,6 +163,10 @@ Q_SIGNALS:
 
     void errorMessage(const QString &str);
     void imageExported(const ExportManager::Actions &actions, const QUrl &url = {});
+    /**
+     * Emitted after errorMessage() when saving the image to @p url failed.
+     */
+    void imageSaveFailed(const QUrl &url);
     void videoExported(const ExportManager::Actions &actions, const QUrl &url = {});
     void qrCodeScanned(const QVariant &content);
 
@@ -151,10 +176,23 @@ private:
     QString autoIncrementFilename(const QString &baseName, const QString &extension, FileNameAlreadyUsedCheck isFileNameUsed) const;
     QString imageFileSuffix(const QUrl &url) const;
     bool writeImage(QIODevice *device, const QByteArray &suffix, QByteArrayView encodedImage = {});
-    bool save(const QUrl &url, QByteArrayView encodedImage = {});
-    bool localSave(const QUrl &url, const QString &suffix, QByteArrayView encodedImage);
-    bool remoteSave(const QUrl &url, const QString &suffix, QByteArrayView encodedImage);
     bool isTempFileAlreadyUsed(const QUrl &url) const;
+    void startBackgroundEncode();
+    /**
+     * Cancel image exports that save to @p saveUrl and haven't finished yet,
+     * because a newer export replaces the file. Canceled exports emit nothing.
+     */
+    void cancelExports(const QUrl &saveUrl);
+
+    struct ExportJob;
+    struct ExportResult {
+        QByteArray savedImageData;
+        QString errorString;
+        qint64 sourceCacheKey = 0;
+        bool saved = false;
+    };
+    void remoteSave(const std::shared_ptr<ExportJob> &job, bool createdDirectory, std::function<void(bool)> done);
+    void finishExport(const std::shared_ptr<ExportJob> &job, Actions actions, QUrl url, const ExportResult &result);
 
     bool m_imageSavedNotInTemp;
     QImage m_saveImage;
@@ -163,6 +201,9 @@ private:
     std::unique_ptr<QLockFile> m_tempDirLock;
     std::unique_ptr<QTemporaryDir> m_tempDir;
     QList<QUrl> m_usedTempFileNames;
+    QList<std::shared_ptr<ExportJob>> m_exportJobs;
+    std::shared_ptr<EncodedImageCache> m_encodedImageCache;
+    std::shared_ptr<std::atomic_bool> m_backgroundEncodeCanceled;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(ExportManager::Actions)
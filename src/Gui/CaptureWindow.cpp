@@ -25,6 +25,7 @@ qreal CaptureWindow::s_maxDevicePixelRatio = 1;
 
 CaptureWindow::CaptureWindow(Mode mode, QScreen *screen, QQmlEngine *engine, QWindow *parent)
     : SpectacleWindow(engine, parent)
+    , m_mode(mode)
     , m_screenToFollow(screen)
 {
     s_captureWindowInstances.append(this);
@@ -106,6 +107,16 @@ CaptureWindow::UniquePointer CaptureWindow::makeUnique(Mode mode, QScreen *scree
     });
 }
 
+CaptureWindow::UniquePointer CaptureWindow::makePooled(Mode mode, QScreen *screen, QQmlEngine *engine)
+{
+    // Don't change the annotating state of windows that are currently in use.
+    const bool wasAnnotating = s_isAnnotating;
+    auto window = makeUnique(mode, screen, engine);
+    window->setPooled(true);
+    s_isAnnotating = wasAnnotating;
+    return window;
+}
+
 QList<CaptureWindow *> CaptureWindow::instances()
 {
     return s_captureWindowInstances;
@@ -116,6 +127,37 @@ QScreen *CaptureWindow::screenToFollow() const
     return m_screenToFollow;
 }
 
+CaptureWindow::Mode CaptureWindow::mode() const
+{
+    return m_mode;
+}
+
+bool CaptureWindow::isPooled() const
+{
+    return m_pooled;
+}
+
+void CaptureWindow::setPooled(bool pooled)
+{
+    if (m_pooled == pooled) {
+        return;
+    }
+    m_pooled = pooled;
+    if (pooled) {
+        // Remove it from the instance lists first, so hiding it doesn't get synced to other windows.
+        s_captureWindowInstances.removeOne(this);
+        s_spectacleWindowInstances.removeOne(this);
+        setVisible(false);
+    } else {
+        s_spectacleWindowInstances.append(this);
+        s_captureWindowInstances.append(this);
+        s_isAnnotating = true;
+        m_pressedButtons = Qt::NoButton;
+        m_pressedKeys = {};
+        syncGeometryWithScreen();
+    }
+}
+
 qreal CaptureWindow::maxDevicePixelRatio()
 {
     return s_maxDevicePixelRatio;
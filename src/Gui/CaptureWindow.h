@@ -30,10 +30,24 @@ public:
 
     static UniquePointer makeUnique(Mode mode, QScreen *screen, QQmlEngine *engine, QWindow *parent = nullptr);
 
+    /**
+     * Create a hidden window that is already pooled, so its QML is ready before it is needed.
+     */
+    static UniquePointer makePooled(Mode mode, QScreen *screen, QQmlEngine *engine);
+
     static QList<CaptureWindow *> instances();
 
     QScreen *screenToFollow() const;
 
+    Mode mode() const;
+
+    /**
+     * Pooled windows are hidden and excluded from instances() and SpectacleWindow::instances(),
+     * so they can be kept around and shown again for the next capture.
+     */
+    bool isPooled() const;
+    void setPooled(bool pooled);
+
     static qreal maxDevicePixelRatio();
 
 public Q_SLOTS:
@@ -61,7 +75,9 @@ private:
     void setMode(CaptureWindow::Mode mode);
     void syncGeometryWithScreen();
 
+    const Mode m_mode;
     QPointer<QScreen> m_screenToFollow;
+    bool m_pooled = false;
     static QList<CaptureWindow *> s_captureWindowInstances;
     static qreal s_maxDevicePixelRatio;
 };
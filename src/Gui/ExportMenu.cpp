@@ -89,6 +89,41 @@ void ExportMenu::onImageChanged()
 #endif
 }
 
+void ExportMenu::withSavedImage(const std::function<void(const QUrl &)> &function)
+{
+    // Annotations that haven't been synced yet make the saved file outdated.
+    SpectacleCore::instance()->syncExportImage();
+    auto exportManager = ExportManager::instance();
+    if (exportManager->isImageSavedNotInTemp()) {
+        function(Settings::self()->lastImageSaveLocation());
+        return;
+    }
+
+    // Images are saved in the background, so wait until the file has been written.
+    // An autosave or an earlier export of the same image may already be writing it.
+    const QUrl pendingUrl = exportManager->pendingSaveUrl();
+    const QUrl filename = pendingUrl.isValid() ? pendingUrl : exportManager->getAutosaveFilename();
+    auto context = new QObject(this);
+    connect(exportManager, &ExportManager::imageExported, context, [context, filename, function](const ExportManager::Actions &actions, const QUrl &url) {
+        if (url != filename) {
+            return;
+        }
+        context->deleteLater();
+        if (actions & ExportManager::AnySave) {
+            function(url);
+        }
+    });
+    // Errors of other exports that are running at the same time don't matter here.
+    connect(exportManager, &ExportManager::imageSaveFailed, context, [context, filename](const QUrl &url) {
+        if (url == filename) {
+            context->deleteLater();
+        }
+    });
+    if (!pendingUrl.isValid()) {
+        exportManager->exportImage(ExportManager::Save, filename);
+    }
+}
+
 void ExportMenu::getKServiceItems()
 {
     // populate all locally installed applications and services
@@ -105,22 +140,15 @@ void ExportMenu::getKServiceItems()
             if(captureWindow && !captureWindow->accept()) {
                 return;
             }
-            QUrl filename;
-            if(ExportManager::instance()->isImageSavedNotInTemp()) {
-                filename = Settings::self()->lastImageSaveLocation();
-            } else {
-                filename = ExportManager::instance()->getAutosaveFilename();
-                SpectacleCore::instance()->syncExportImage();
-                ExportManager::instance()->exportImage(ExportManager::Save, filename);
-            }
-
-            auto *job = new KIO::ApplicationLauncherJob(service);
-            auto *delegate = new KNotificationJobUiDelegate;
-            delegate->setAutoErrorHandlingEnabled(true);
-            job->setUiDelegate(delegate);
-
-            job->setUrls({filename});
-            job->start();
+            withSavedImage([service](const QUrl &filename) {
+                auto *job = new KIO::ApplicationLauncherJob(service);
+                auto *delegate = new KNotificationJobUiDelegate;
+                delegate->setAutoErrorHandlingEnabled(true);
+                job->setUiDelegate(delegate);
+
+                job->setUrls({filename});
+                job->start();
+            });
         });
         addAction(action);
     }
@@ -138,19 +166,12 @@ void ExportMenu::getKServiceItems()
         if(captureWindow && !captureWindow->accept()) {
             return;
         }
-        QUrl filename;
-        if(ExportManager::instance()->isImageSavedNotInTemp()) {
-            filename = Settings::self()->lastImageSaveLocation();
-        } else {
-            filename = ExportManager::instance()->getAutosaveFilename();
-            SpectacleCore::instance()->syncExportImage();
-            ExportManager::instance()->exportImage(ExportManager::Save, filename);
-        }
-
-        auto job = new KIO::ApplicationLauncherJob;
-        job->setUiDelegate(KIO::createDefaultJobUiDelegate(KJobUiDelegate::AutoHandlingEnabled, window()));
-        job->setUrls({filename});
-        job->start();
+        withSavedImage([this](const QUrl &filename) {
+            auto job = new KIO::ApplicationLauncherJob;
+            job->setUiDelegate(KIO::createDefaultJobUiDelegate(KJobUiDelegate::AutoHandlingEnabled, window()));
+            job->setUrls({filename});
+            job->start();
+        });
     });
     addAction(openWith);
 }
@@ -186,6 +207,7 @@ void ExportMenu::loadPurposeMenu()
         if (captureWindow && !captureWindow->accept()) {
             return;
         }
+        SpectacleCore::instance()->syncExportImage();
         const QString dataUri = ExportManager::instance()->tempSave().toString();
         auto mimeType = QMimeDatabase().mimeTypeForFile(dataUri).name();
         QJsonObject inputData = {{u"mimeType"_s, mimeType}, {u"urls"_s, QJsonArray({dataUri})}};
@@ -196,6 +218,8 @@ void ExportMenu::loadPurposeMenu()
 
 void ExportMenu::loadPurposeItems()
 {
+    // Sets mUpdatedImageAvailable if there are annotations that haven't been synced yet.
+    SpectacleCore::instance()->syncExportImage();
     if (!mUpdatedImageAvailable) {
         return;
     }
@@ -237,6 +261,8 @@ void ExportMenu::openPrintDialog()
 
     connect(dialog, &QDialog::finished, dialog, [printer](int result){
         if (result == QDialog::Accepted) {
+            // Annotations may have changed while the dialog was open.
+            SpectacleCore::instance()->syncExportImage();
             ExportManager::instance()->doPrint(printer);
         }
         delete printer;
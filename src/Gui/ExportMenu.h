@@ -54,6 +54,10 @@ private:
     Q_SLOT void triggerExtraction(const QString &languageCode);
 
     void getKServiceItems();
+    /**
+     * Calls the function with the URL of the saved screenshot, saving it first if necessary.
+     */
+    void withSavedImage(const std::function<void(const QUrl &)> &function);
     void createOcrLanguageSubmenu();
 
 #ifdef PURPOSE_FOUND
@@ -264,7 +264,6 @@ void SpectacleWindow::copyLocation()
 
 void SpectacleWindow::showPrintDialog()
 {
-    SpectacleCore::instance()->syncExportImage();
     ExportMenu::instance()->openPrintDialog();
 }
 
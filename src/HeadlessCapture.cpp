@@ -0,0 +1,129 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "HeadlessCapture.h"
+#include "CommandLineOptions.h"
+#include "DebugUtils.h"
+
+#include <KLocalizedString>
+
+#include <QCommandLineParser>
+#include <QTimer>
+
+#include <algorithm>
+
+using namespace Qt::StringLiterals;
+
+HeadlessCapture::HeadlessCapture(std::unique_ptr<ImagePlatform> imagePlatform, QObject *parent)
+    : QObject(parent)
+    , m_imagePlatform(std::move(imagePlatform))
+{
+    m_timer.start();
+}
+
+HeadlessCapture::~HeadlessCapture() = default;
+
+bool HeadlessCapture::canHandle(const QCommandLineParser &parser)
+{
+    const auto options = CommandLineOptions::self();
+    if (!parser.isSet(options->background) || !parser.isSet(options->noNotify)) {
+        return false;
+    }
+    // These need windows, or a viewer for the result.
+    // Background mode takes precedence over DBus mode, so that doesn't matter.
+    const auto interactiveOptions = {&options->gui, &options->launchOnly, &options->editExisting, &options->region, &options->record};
+    return std::none_of(interactiveOptions.begin(), interactiveOptions.end(), [&parser](const QCommandLineOption *option) {
+        return parser.isSet(*option);
+    });
+}
+
+void HeadlessCapture::start(const QCommandLineParser &parser)
+{
+    using GrabMode = ImagePlatform::GrabMode;
+    using ShutterMode = ImagePlatform::ShutterMode;
+    using StartMode = CommandLineOptions::StartMode;
+
+    // The same helpers as SpectacleCore::activate() in background mode.
+    auto values = CommandLineOptions::values(parser);
+    const auto captureSettings = CommandLineOptions::captureSettings(StartMode::Background, values);
+    const auto shutterModes = m_imagePlatform->supportedShutterModes();
+    const bool onClick = captureSettings.onClick && shutterModes.testFlag(ShutterMode::OnClick);
+    int delayMsec = CommandLineOptions::delay(parser, onClick);
+    const auto grabMode = CommandLineOptions::grabMode(values).value_or(GrabMode::AllScreens);
+    m_outputUrl = CommandLineOptions::outputUrl(parser, values);
+    m_actions = CommandLineOptions::autoExportActions(StartMode::Background, values, false);
+
+    // See SpectacleCore::takeNewScreenshot()
+    auto shutterMode = ShutterMode::Immediate;
+    if ((delayMsec < 0 || !shutterModes.testFlag(ShutterMode::Immediate)) && shutterModes.testFlag(ShutterMode::OnClick)) {
+        shutterMode = ShutterMode::OnClick;
+        delayMsec = 0;
+    } else {
+        delayMsec = qMax(qMax(0, delayMsec), m_imagePlatform->minimumCaptureDelay());
+    }
+
+    auto imagePlatform = m_imagePlatform.get();
+    connect(imagePlatform, &ImagePlatform::newScreenshotTaken, this, &HeadlessCapture::onScreenshotTaken);
+    // Only region captures are croppable. Export the whole image if a platform sends one anyway.
+    connect(imagePlatform, &ImagePlatform::newCroppableScreenshotTaken, this, &HeadlessCapture::onScreenshotTaken);
+    connect(imagePlatform, &ImagePlatform::newScreenshotFailed, this, [this](const QString &message) {
+        auto uiMessage = i18nc("@info", "An error occurred while taking a screenshot.");
+        if (!message.isEmpty()) {
+            uiMessage = uiMessage % u"\n"_s % message;
+        }
+        qWarning().noquote() << uiMessage;
+        finish(1);
+    });
+    connect(imagePlatform, &ImagePlatform::newScreenshotCanceled, this, [this] {
+        finish(1);
+    });
+
+    auto exportManager = ExportManager::instance();
+    connect(exportManager, &ExportManager::imageExported, this, [this](const ExportManager::Actions &actions) {
+        m_finishing = true;
+        if (actions & ExportManager::CopyImage) {
+            // Allow some time for clipboard content to transfer, like SpectacleCore does with --nonotify.
+            QTimer::singleShot(250, this, [this] {
+                finish(m_exportFailed ? 1 : 0);
+            });
+        } else {
+            finish(m_exportFailed ? 1 : 0);
+        }
+    });
+    connect(exportManager, &ExportManager::errorMessage, this, [this](const QString &message) {
+        qWarning().noquote() << message;
+        m_exportFailed = true;
+        // imageExported() isn't emitted if none of the actions succeeded.
+        QTimer::singleShot(0, this, [this] {
+            if (!m_finishing && !ExportManager::instance()->isExporting()) {
+                finish(1);
+            }
+        });
+    });
+
+    QTimer::singleShot(delayMsec, this, [=, this] {
+        imagePlatform->doGrab(shutterMode, grabMode, captureSettings.includePointer, captureSettings.includeDecorations, captureSettings.includeShadow);
+    });
+}
+
+void HeadlessCapture::onScreenshotTaken(const QImage &image)
+{
+    Log::debug() << "Headless capture took" << m_timer.elapsed() << "ms to grab the screenshot";
+    auto exportManager = ExportManager::instance();
+    exportManager->setImage(image);
+    exportManager->updateTimestamp();
+    exportManager->exportImage(m_actions, m_outputUrl);
+}
+
+void HeadlessCapture::finish(int exitCode)
+{
+    if (m_finished) {
+        return;
+    }
+    m_finished = true;
+    Log::debug() << "Headless capture finished after" << m_timer.elapsed() << "ms";
+    Q_EMIT finished(exitCode);
+}
+
+#include "moc_HeadlessCapture.cpp"
@@ -0,0 +1,61 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include "ExportManager.h"
+#include "Platforms/ImagePlatform.h"
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QUrl>
+
+#include <memory>
+
+class QCommandLineParser;
+
+/**
+ * Takes a screenshot and exports it without creating SpectacleCore, windows, QML or OCR.
+ *
+ * Background mode captures that don't notify and don't need user interaction
+ * (for example `spectacle -b -n -o file.png`) only have to grab, encode and exit,
+ * so they use this instead of SpectacleCore.
+ */
+class HeadlessCapture : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HeadlessCapture(std::unique_ptr<ImagePlatform> imagePlatform, QObject *parent = nullptr);
+    ~HeadlessCapture() override;
+
+    /**
+     * Whether the parsed command line can be handled without SpectacleCore.
+     */
+    static bool canHandle(const QCommandLineParser &parser);
+
+    /**
+     * Take and export a screenshot like SpectacleCore does in background mode.
+     * finished() is emitted once the screenshot has been exported or has failed.
+     */
+    void start(const QCommandLineParser &parser);
+
+Q_SIGNALS:
+    /**
+     * The exit code is 1 if the screenshot couldn't be taken or exported.
+     */
+    void finished(int exitCode);
+
+private:
+    void onScreenshotTaken(const QImage &image);
+    void finish(int exitCode);
+
+    std::unique_ptr<ImagePlatform> m_imagePlatform;
+    ExportManager::Actions m_actions;
+    QUrl m_outputUrl;
+    QElapsedTimer m_timer;
+    bool m_exportFailed = false;
+    bool m_finishing = false;
+    bool m_finished = false;
+};
@@ -6,6 +6,8 @@
  */
 
 #include "Config.h"
+#include "HeadlessCapture.h"
+#include "Platforms/PlatformLoader.h"
 #include "ShortcutActions.h"
 #include "SpectacleCore.h"
 #include "CommandLineOptions.h"
@@ -86,6 +88,22 @@ int main(int argc, char **argv)
     QObject::connect(&app, &QGuiApplication::commitDataRequest, disableSessionManagement);
     QObject::connect(&app, &QGuiApplication::saveStateRequest, disableSessionManagement);
 
+    // Background captures that don't notify and don't need a window only have to grab, encode and exit.
+    // Skip SpectacleCore, QML and the DBus service for those to start up as fast as possible.
+    if (HeadlessCapture::canHandle(commandLineParser)) {
+        HeadlessCapture headlessCapture(loadImagePlatform());
+        // Exports hold QEventLoopLockers. Without windows, releasing the last one would quit
+        // with exit code 0 before finished() can set the real exit code.
+        QCoreApplication::setQuitLockEnabled(false);
+
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, Settings::self(), &Settings::save);
+        QObject::connect(&headlessCapture, &HeadlessCapture::finished, &app, &QCoreApplication::exit, Qt::QueuedConnection);
+
+        headlessCapture.start(commandLineParser);
+
+        return app.exec();
+    }
+
     // If the new instance command line option has been specified,
     // use this alternative path for executing Spectacle.
     if (commandLineParser.isSet(CommandLineOptions::self()->newInstance)) {
@@ -111,7 +129,18 @@ int main(int argc, char **argv)
     QObject::connect(&service, &KDBusService::activateActionRequested, spectacleCore, &SpectacleCore::activateAction);
 
     QObject::connect(&app, &QCoreApplication::aboutToQuit, Settings::self(), &Settings::save);
-    QObject::connect(spectacleCore, &SpectacleCore::allDone, &app, &QCoreApplication::quit, Qt::QueuedConnection);
+    QObject::connect(spectacleCore, &SpectacleCore::allDone, &app, [spectacleCore] {
+        if (!spectacleCore->isResident()) {
+            QCoreApplication::quit();
+        }
+    }, Qt::QueuedConnection);
+
+    // Only the unique instance can stay resident, since it is the one that receives activation requests.
+    auto updateResident = [spectacleCore] {
+        spectacleCore->setResident(Settings::runInBackground() || spectacleCore->isAgentStarted());
+    };
+    updateResident();
+    QObject::connect(Settings::self(), &Settings::configChanged, spectacleCore, updateResident);
 
     // create the dbus connections
     SpectacleDBusAdapter *dbusAdapter = new SpectacleDBusAdapter(spectacleCore);
@@ -12,16 +12,22 @@
 #include <QBuffer>
 #include <QClipboard>
 #include <QDir>
+#include <QDirIterator>
 #include <QFile>
+#include <QFileInfo>
 #include <QLocale>
 #include <QMutexLocker>
+#include <QSet>
 #include <QStandardPaths>
 #include <QStringList>
 #include <QThread>
 
+#include <KConfigGroup>
 #include <KLocalizedString>
+#include <KSharedConfig>
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
 
 using namespace Qt::StringLiterals;
@@ -30,7 +36,6 @@ OcrManager *OcrManager::s_instance = nullptr;
 
 OcrManager::OcrManager(QObject *parent)
     : QObject(parent)
-    , m_tesseract(nullptr)
     , m_worker(nullptr)
     , m_workerThread(std::make_unique<QThread>())
     , m_timeoutTimer(new QTimer(this))
@@ -40,6 +45,8 @@ OcrManager::OcrManager(QObject *parent)
     , m_activeLanguages()
     , m_shouldRestoreToConfigured(false) // Flag to restore after temp language use
     , m_initialized(false)
+    , m_resultModel(new OcrResultModel(this))
+    , m_resultCache(MAX_CACHED_RESULTS)
 {
     m_timeoutTimer->setSingleShot(true);
     m_timeoutTimer->setInterval(30000);
@@ -52,6 +59,14 @@ OcrManager::OcrManager(QObject *parent)
     m_worker = new OcrWorker();
     m_worker->moveToThread(m_workerThread.get());
     connect(m_worker, &OcrWorker::imageProcessed, this, &OcrManager::handleRecognitionComplete);
+    // The first recognition with some languages loads their data once per engine, which can take
+    // longer than recognizing the text. Only time out if a request stops making progress.
+    connect(m_worker, &OcrWorker::engineInitialized, this, [this](quint64 requestId) {
+        if (requestId == m_lastRequestId && m_timeoutTimer->isActive()) {
+            m_timeoutTimer->start();
+        }
+    });
+    connect(m_worker, &OcrWorker::languagesDiscovered, this, &OcrManager::handleLanguagesDiscovered);
     m_workerThread->start();
 
     connect(Settings::self(), &Settings::ocrLanguagesChanged, this, [this]() {
@@ -65,7 +80,7 @@ OcrManager::OcrManager(QObject *parent)
         }
     });
 
-    QTimer::singleShot(0, this, &OcrManager::initializeTesseract);
+    QTimer::singleShot(0, this, &OcrManager::initializeLanguages);
 }
 
 OcrManager::~OcrManager()
@@ -82,11 +97,6 @@ OcrManager::~OcrManager()
         delete m_worker;
         m_worker = nullptr;
     }
-    if (m_tesseract) {
-        m_tesseract->End();
-        delete m_tesseract;
-        m_tesseract = nullptr;
-    }
 }
 
 OcrManager *OcrManager::instance()
@@ -99,7 +109,12 @@ OcrManager *OcrManager::instance()
 
 bool OcrManager::isAvailable() const
 {
-    return m_initialized && m_tesseract != nullptr;
+    return m_initialized && !m_availableLanguages.isEmpty();
+}
+
+OcrResultModel *OcrManager::resultModel() const
+{
+    return m_resultModel;
 }
 
 OcrManager::OcrStatus OcrManager::status() const
@@ -230,13 +245,28 @@ void OcrManager::recognizeTextWithLanguage(const QImage &image, const QString &l
     beginRecognition(image);
 }
 
-void OcrManager::handleRecognitionComplete(const QString &text, bool success)
+void OcrManager::handleRecognitionComplete(quint64 requestId, const OcrResult &result, bool success)
 {
+    // Requests that timed out still finish. Their results are cached for their own image,
+    // but a newer request has replaced them since.
+    if (const auto it = m_pendingResultKeys.constFind(requestId); it != m_pendingResultKeys.cend()) {
+        if (success) {
+            m_resultCache.insert(*it, new OcrResult(result));
+        }
+        m_pendingResultKeys.erase(it);
+    }
+    if (requestId != m_lastRequestId) {
+        qCDebug(SPECTACLE_LOG) << "Ignoring the result of an earlier OCR request";
+        return;
+    }
+
     m_timeoutTimer->stop();
 
     if (success) {
         setStatus(OcrStatus::Ready);
+        m_resultModel->setResult(result);
 
+        const QString text = result.text();
         if (!text.isEmpty()) {
             QApplication::clipboard()->setText(text);
         }
@@ -297,11 +327,7 @@ bool OcrManager::validateAndApplyLanguages(const QStringList &languageCodes)
         return true;
     }
 
-    if (!setupTesseractLanguages(validLanguages)) {
-        qCWarning(SPECTACLE_LOG) << "Failed to apply OCR languages:" << combinedLanguages;
-        return false;
-    }
-
+    // The worker initializes its engines with the new languages when they are used next.
     m_activeLanguages = validLanguages;
     m_currentLanguageCode = combinedLanguages;
 
@@ -312,105 +338,117 @@ bool OcrManager::validateAndApplyLanguages(const QStringList &languageCodes)
 void OcrManager::beginRecognition(const QImage &image)
 {
     setStatus(OcrStatus::Processing);
+
+    const quint64 requestId = ++m_lastRequestId;
+    // The cache key changes whenever the image is modified, so results can be reused until then.
+    const ResultKey resultKey{image.cacheKey(), m_currentLanguageCode};
+    if (const auto cachedResult = m_resultCache.object(resultKey)) {
+        qCDebug(SPECTACLE_LOG) << "Using cached OCR result";
+        // Finish asynchronously, like a recognition on the worker thread.
+        QMetaObject::invokeMethod(
+            this,
+            [this, requestId, result = *cachedResult]() {
+                handleRecognitionComplete(requestId, result, true);
+            },
+            Qt::QueuedConnection);
+        return;
+    }
+
+    m_pendingResultKeys.insert(requestId, resultKey);
     m_timeoutTimer->start();
 
     QMetaObject::invokeMethod(
         m_worker,
-        [worker = m_worker, image, tesseract = m_tesseract]() {
-            worker->processImage(image, tesseract);
+        [worker = m_worker, requestId, image, datapath = m_datapath, languages = m_currentLanguageCode]() {
+            worker->processImage(requestId, image, datapath, languages);
         },
         Qt::QueuedConnection);
 }
 
-void OcrManager::initializeTesseract()
+void OcrManager::initializeLanguages()
 {
-    auto cleanupTesseract = [this]() {
-        if (m_tesseract) {
-            m_tesseract->End();
-            delete m_tesseract;
-            m_tesseract = nullptr;
-        }
-    };
-
-    try {
-        m_tesseract = new TessBaseAPI;
-
-        if (m_tesseract->Init(nullptr, nullptr) != 0) {
-            qCWarning(SPECTACLE_LOG) << "Failed to initialize Tesseract OCR engine";
-            setStatus(OcrStatus::Error);
-            cleanupTesseract();
-            return;
-        }
-
-        const char *datapath = m_tesseract->GetDatapath();
-        QString tessdataPath = datapath ? QString::fromUtf8(datapath) : QString();
-        if (tessdataPath.isEmpty()) {
-            qCWarning(SPECTACLE_LOG) << "Tesseract datapath is empty";
-            setStatus(OcrStatus::Error);
-            cleanupTesseract();
-            return;
-        }
-        qCDebug(SPECTACLE_LOG) << "Using tessdata path:" << tessdataPath;
-
-        setupAvailableLanguages(tessdataPath);
-
-        if (m_availableLanguages.isEmpty()) {
-            qCWarning(SPECTACLE_LOG) << "No language data files found in tessdata directory";
-            setStatus(OcrStatus::Error);
-            cleanupTesseract();
-            return;
-        }
-
-        m_tesseract->End();
-
-        QStringList configLanguages = Settings::ocrLanguages();
-        QStringList initLanguages;
-
-        // Use configured languages if valid, otherwise fallback to first available
-        for (const QString &lang : configLanguages) {
-            if (!lang.isEmpty() && m_availableLanguages.contains(lang) && lang != u"osd"_s) {
-                initLanguages.append(lang);
-            }
-        }
+    if (loadLanguageIndex()) {
+        return;
+    }
+    // Initializing Tesseract loads language data, so don't block the event loop with it.
+    QMetaObject::invokeMethod(m_worker, &OcrWorker::discoverLanguages, Qt::QueuedConnection);
+}
 
-        if (initLanguages.isEmpty()) {
-            auto it = std::find_if(m_availableLanguages.begin(), m_availableLanguages.end(), [](const QString &lang) {
-                return lang != u"osd"_s;
-            });
+// Tesseract also finds languages in subdirectories, like script/Latin, so those count too.
+// Only directories are listed, so this stays cheap even with many languages installed.
+static qint64 tessdataModified(const QString &datapath)
+{
+    const QFileInfo info(datapath);
+    if (!info.isDir()) {
+        return -1;
+    }
+    qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    QDirIterator it(datapath, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        modified = std::max(modified, it.nextFileInfo().lastModified().toMSecsSinceEpoch());
+    }
+    return modified;
+}
 
-            if (it != m_availableLanguages.end()) {
-                initLanguages.append(*it);
-            } else {
-                qCCritical(SPECTACLE_LOG) << "No fallback language available (only osd present)";
-                setStatus(OcrStatus::Error);
-                cleanupTesseract();
-                return;
-            }
-        }
+bool OcrManager::loadLanguageIndex()
+{
+    const auto group = KSharedConfig::openStateConfig()->group(u"OcrLanguageIndex"_s);
+    const QString datapath = group.readEntry("Datapath", QString());
+    if (datapath.isEmpty()
+        || group.readEntry("TessdataPrefix", QString()) != qEnvironmentVariable("TESSDATA_PREFIX")
+        // Adding or removing language data changes the modification time of the directory.
+        || group.readEntry("Modified", qint64(-1)) != tessdataModified(datapath)) {
+        return false;
+    }
+    const QStringList languages = group.readEntry("Languages", QStringList());
+    if (languages.isEmpty()) {
+        return false;
+    }
+    qCDebug(SPECTACLE_LOG) << "Using cached OCR languages from tessdata path:" << datapath;
+    applyLanguageIndex(datapath, languages);
+    return true;
+}
 
-        const QString combinedInitLanguages = initLanguages.join(u"+"_s);
-        qCDebug(SPECTACLE_LOG) << "Initializing Tesseract with languages:" << combinedInitLanguages;
+void OcrManager::handleLanguagesDiscovered(const QString &datapath, const QStringList &languages)
+{
+    if (datapath.isEmpty() || languages.isEmpty()) {
+        qCWarning(SPECTACLE_LOG) << "No language data files found in tessdata directory";
+        setStatus(OcrStatus::Error);
+        return;
+    }
 
-        if (m_tesseract->Init(nullptr, combinedInitLanguages.toUtf8().constData()) != 0) {
-            qCWarning(SPECTACLE_LOG) << "Failed to initialize Tesseract with languages:" << combinedInitLanguages;
-            setStatus(OcrStatus::Error);
-            cleanupTesseract();
-            return;
-        }
+    auto group = KSharedConfig::openStateConfig()->group(u"OcrLanguageIndex"_s);
+    group.writeEntry("Datapath", datapath);
+    group.writeEntry("TessdataPrefix", qEnvironmentVariable("TESSDATA_PREFIX"));
+    group.writeEntry("Modified", tessdataModified(datapath));
+    group.writeEntry("Languages", languages);
+    group.sync();
 
-        m_currentLanguageCode = combinedInitLanguages;
-        m_tesseract->SetPageSegMode(tesseract::PSM_AUTO);
+    applyLanguageIndex(datapath, languages);
+}
 
-        m_initialized = true;
-        setStatus(OcrStatus::Ready);
-        qCDebug(SPECTACLE_LOG) << "Tesseract OCR engine initialized successfully with languages:" << combinedInitLanguages;
+void OcrManager::applyLanguageIndex(const QString &datapath, const QStringList &languages)
+{
+    qCDebug(SPECTACLE_LOG) << "Using tessdata path:" << datapath;
+    m_datapath = datapath;
+    setupAvailableLanguages(languages);
 
-        loadSavedLanguageSetting();
-    } catch (const std::exception &e) {
-        qCWarning(SPECTACLE_LOG) << "Exception during Tesseract initialization:" << e.what();
+    const bool hasLanguage = std::any_of(m_availableLanguages.cbegin(), m_availableLanguages.cend(), [](const QString &lang) {
+        return lang != u"osd"_s;
+    });
+    if (!hasLanguage) {
+        qCCritical(SPECTACLE_LOG) << "No fallback language available (only osd present)";
+        m_availableLanguages.clear();
         setStatus(OcrStatus::Error);
-        cleanupTesseract();
+        return;
     }
+
+    m_initialized = true;
+    loadSavedLanguageSetting();
+    // Availability changed, so notify even if the status is the same.
+    m_status = OcrStatus::Ready;
+    Q_EMIT statusChanged(m_status);
+    qCDebug(SPECTACLE_LOG) << "OCR is available with languages:" << m_currentLanguageCode;
 }
 
 void OcrManager::loadSavedLanguageSetting()
@@ -475,104 +513,11 @@ bool OcrManager::isLanguageAvailable(const QString &languageCode) const
     return m_availableLanguages.contains(languageCode);
 }
 
-bool OcrManager::setupTesseractLanguages(const QStringList &langCodes)
-{
-    if (!m_tesseract || langCodes.isEmpty()) {
-        return false;
-    }
-
-    const char *datapath = m_tesseract->GetDatapath();
-    QString tessdataPath = datapath ? QString::fromUtf8(datapath) : QString();
-
-    if (tessdataPath.isEmpty()) {
-        qCWarning(SPECTACLE_LOG) << "Tessdata path not found";
-        return false;
-    }
-
-    for (const QString &langCode : langCodes) {
-        const QString langFile = QDir(tessdataPath).filePath(langCode + u".traineddata"_s);
-        if (!QFile::exists(langFile)) {
-            qCWarning(SPECTACLE_LOG) << "Language file not found:" << langFile;
-            return false;
-        }
-    }
-
-    try {
-        m_tesseract->End();
-
-        const QString combinedLangs = langCodes.join(u"+"_s);
-
-        if (m_tesseract->Init(nullptr, combinedLangs.toUtf8().constData()) != 0) {
-            // Fallback to first available language
-            QString fallbackLang;
-            if (!m_availableLanguages.isEmpty()) {
-                auto it = std::find_if(m_availableLanguages.begin(), m_availableLanguages.end(), [](const QString &lang) {
-                    return lang != u"osd"_s;
-                });
-                if (it != m_availableLanguages.end()) {
-                    fallbackLang = *it;
-                }
-            }
-
-            if (fallbackLang.isEmpty() || m_tesseract->Init(nullptr, fallbackLang.toUtf8().constData()) != 0) {
-                qCWarning(SPECTACLE_LOG) << "Failed to initialize Tesseract with languages:" << combinedLangs << "and fallback:" << fallbackLang;
-                return false;
-            }
-
-            m_activeLanguages = QStringList{fallbackLang};
-            m_currentLanguageCode = fallbackLang;
-        }
-
-        m_tesseract->SetPageSegMode(tesseract::PSM_AUTO);
-        return true;
-    } catch (const std::exception &e) {
-        qCWarning(SPECTACLE_LOG) << "Exception while setting up Tesseract languages:" << e.what();
-        return false;
-    }
-}
-
-void OcrManager::setupAvailableLanguages(const QString &tessdataPath)
+void OcrManager::setupAvailableLanguages(const QStringList &languages)
 {
-    m_availableLanguages.clear();
+    m_availableLanguages = languages;
     m_languageNames.clear();
 
-    if (!m_tesseract) {
-        qCWarning(SPECTACLE_LOG) << "Cannot enumerate OCR languages: Tesseract not initialized";
-        return;
-    }
-
-    QStringList detectedLanguages;
-
-    std::vector<std::string> languages;
-    m_tesseract->GetAvailableLanguagesAsVector(&languages);
-    if (languages.empty()) {
-        qCWarning(SPECTACLE_LOG) << "Tesseract API returned no languages";
-        return;
-    }
-
-    detectedLanguages.reserve(languages.size());
-    for (const auto &entry : languages) {
-        const QString langCode = QString::fromUtf8(entry);
-        if (langCode.isEmpty()) {
-            continue;
-        }
-
-        if (!tessdataPath.isEmpty()) {
-            const QString trainedDataPath = QDir(tessdataPath).filePath(langCode + u".traineddata"_s);
-            if (!QFile::exists(trainedDataPath)) {
-                qCDebug(SPECTACLE_LOG) << "Skipping OCR language" << langCode << "- missing traineddata at" << trainedDataPath;
-                continue;
-            }
-        }
-
-        if (!detectedLanguages.contains(langCode)) {
-            detectedLanguages.append(langCode);
-        }
-    }
-
-    std::sort(detectedLanguages.begin(), detectedLanguages.end());
-    m_availableLanguages = detectedLanguages;
-
     for (const QString &langCode : std::as_const(m_availableLanguages)) {
         if (langCode == u"osd"_s) {
             m_languageNames.insert(langCode, i18nc("@item:inlistbox", "Orientation and Script Detection"));
@@ -645,49 +590,370 @@ QString OcrManager::tesseractLangName(const QString &tesseractCode) const
 OcrWorker::OcrWorker(QObject *parent)
     : QObject(parent)
 {
+    m_threadPool.setMaxThreadCount(std::clamp(QThread::idealThreadCount(), 1, MAX_OCR_ENGINES));
 }
 
-void OcrWorker::processImage(const QImage &image, TessBaseAPI *tesseract)
+void OcrWorker::setMaxEngineCount(int count)
 {
     QMutexLocker locker(&m_mutex);
+    m_threadPool.setMaxThreadCount(std::clamp(count, 1, MAX_OCR_ENGINES));
+}
+
+OcrWorker::~OcrWorker()
+{
+    m_threadPool.waitForDone();
+    for (auto &engines : m_engineSets) {
+        releaseEngines(engines);
+    }
+}
+
+void OcrWorker::releaseEngine(Engine &engine)
+{
+    if (engine.tesseract) {
+        engine.tesseract->End();
+        delete engine.tesseract;
+        engine.tesseract = nullptr;
+    }
+    engine.languages.clear();
+}
+
+void OcrWorker::releaseEngines(EngineSet &engines)
+{
+    releaseEngine(engines.engine);
+    for (auto &engine : engines.pool) {
+        releaseEngine(engine);
+    }
+}
+
+qint64 OcrWorker::cacheSize(const EngineSet &engines)
+{
+    const auto isInitialized = [](const Engine &engine) {
+        return !engine.languages.isEmpty();
+    };
+    const qint64 count = isInitialized(engines.engine) + std::count_if(engines.pool.cbegin(), engines.pool.cend(), isInitialized);
+    return count * engines.engineSize;
+}
+
+OcrWorker::EngineSet &OcrWorker::engineSet(const QString &datapath, const QString &languages)
+{
+    const QByteArray datapathData = datapath.toUtf8();
+    const QByteArray languagesData = languages.toUtf8();
+    auto it = std::find_if(m_engineSets.begin(), m_engineSets.end(), [&](const EngineSet &engines) {
+        return engines.datapath == datapathData && engines.languages == languagesData;
+    });
+    if (it != m_engineSets.end()) {
+        m_engineSets.splice(m_engineSets.begin(), m_engineSets, it);
+        return m_engineSets.front();
+    }
 
-    if (!tesseract || image.isNull()) {
-        Q_EMIT imageProcessed(QString(), false);
+    auto &engines = m_engineSets.emplace_front();
+    engines.datapath = datapathData;
+    engines.languages = languagesData;
+    // Most of an engine's memory is the loaded language data, so the file sizes are a good estimate.
+    const QDir dir(datapath);
+    for (const auto &language : languages.split(u'+', Qt::SkipEmptyParts)) {
+        engines.engineSize += QFileInfo(dir.filePath(language + u".traineddata"_s)).size();
+    }
+    return engines;
+}
+
+void OcrWorker::trimEngineCache()
+{
+    if (m_engineSets.empty()) {
         return;
     }
+    // The pool of the most recently used set can be over the limit on its own with large languages.
+    // Keep its main engine, which is needed for every recognition, and release pooled ones.
+    auto &current = m_engineSets.front();
+    for (auto it = current.pool.rbegin(); it != current.pool.rend() && cacheSize(current) > MAX_ENGINE_CACHE_SIZE; ++it) {
+        if (it->tesseract) {
+            qCDebug(SPECTACLE_LOG) << "Releasing a pooled OCR engine for languages:" << current.languages;
+            releaseEngine(*it);
+        }
+    }
+
+    qint64 totalSize = 0;
+    int count = 0;
+    for (auto it = m_engineSets.begin(); it != m_engineSets.end();) {
+        const qint64 size = cacheSize(*it);
+        // Always keep the most recently used engines.
+        if (count > 0 && (count >= MAX_CACHED_LANGUAGE_SETS || totalSize + size > MAX_ENGINE_CACHE_SIZE)) {
+            qCDebug(SPECTACLE_LOG) << "Releasing OCR engines for languages:" << it->languages;
+            releaseEngines(*it);
+            it = m_engineSets.erase(it);
+            continue;
+        }
+        totalSize += size;
+        ++count;
+        ++it;
+    }
+}
+
+static QRectF boundingBox(TessResultIterator *iterator, tesseract::PageIteratorLevel level, const QPoint &offset, qreal scale)
+{
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+    if (!iterator->BoundingBox(level, &left, &top, &right, &bottom)) {
+        return {};
+    }
+    return QRectF(QPointF(left + offset.x(), top + offset.y()) * scale, QPointF(right + offset.x(), bottom + offset.y()) * scale);
+}
+
+bool OcrWorker::recognize(TessBaseAPI *tesseract, const QPoint &offset, qreal scale, OcrResult &result)
+{
+    if (tesseract->Recognize(nullptr) != 0) {
+        return false;
+    }
+
+    TessResultIterator *iterator = tesseract->GetIterator();
+    if (!iterator) {
+        return true;
+    }
+    // Blocks and lines are only added once they have a word, so there are no empty ones.
+    bool newBlock = true;
+    bool newLine = true;
+    do {
+        newBlock = newBlock || iterator->IsAtBeginningOf(tesseract::RIL_BLOCK);
+        newLine = newLine || newBlock || iterator->IsAtBeginningOf(tesseract::RIL_TEXTLINE);
+        char *wordText = iterator->GetUTF8Text(tesseract::RIL_WORD);
+        if (wordText == nullptr) {
+            continue;
+        }
+        const QString word = QString::fromUtf8(wordText).trimmed();
+        delete [] wordText;
+        if (word.isEmpty()) {
+            continue;
+        }
+        if (newBlock) {
+            result.blocks.append({boundingBox(iterator, tesseract::RIL_BLOCK, offset, scale),
+                                  iterator->Confidence(tesseract::RIL_BLOCK),
+                                  int(result.lines.size()),
+                                  0});
+        }
+        if (newLine) {
+            result.lines.append({boundingBox(iterator, tesseract::RIL_TEXTLINE, offset, scale),
+                                 iterator->Confidence(tesseract::RIL_TEXTLINE),
+                                 int(result.blocks.size() - 1),
+                                 int(result.words.size()),
+                                 0});
+            ++result.blocks.last().lineCount;
+        }
+        newBlock = false;
+        newLine = false;
+        result.words.append({word, boundingBox(iterator, tesseract::RIL_WORD, offset, scale), iterator->Confidence(tesseract::RIL_WORD), int(result.lines.size() - 1)});
+        ++result.lines.last().wordCount;
+    } while (iterator->Next(tesseract::RIL_WORD));
+    delete iterator;
+    return true;
+}
+
+QList<QRect> OcrWorker::textBlocks(TessBaseAPI *tesseract)
+{
+    // Layout analysis without recognition is cheap compared to Recognize().
+    // Blocks are returned in reading order.
+    QList<QRect> blocks;
+    TessPageIterator *iterator = tesseract->AnalyseLayout();
+    if (!iterator) {
+        return blocks;
+    }
+    do {
+        if (!tesseract::PTIsTextType(iterator->BlockType())) {
+            continue;
+        }
+        int left = 0;
+        int top = 0;
+        int right = 0;
+        int bottom = 0;
+        if (iterator->BoundingBox(tesseract::RIL_BLOCK, &left, &top, &right, &bottom)) {
+            blocks.append(QRect(QPoint(left, top), QPoint(right - 1, bottom - 1)));
+        }
+    } while (iterator->Next(tesseract::RIL_BLOCK));
+    delete iterator;
+    return blocks;
+}
+
+TessBaseAPI *OcrWorker::initializedEngine(Engine &engine, const QByteArray &datapath, const QByteArray &languages, tesseract::PageSegMode pageSegMode)
+{
+    if (engine.tesseract && engine.languages == languages) {
+        return engine.tesseract;
+    }
+    if (!engine.tesseract) {
+        engine.tesseract = new TessBaseAPI;
+    } else {
+        engine.tesseract->End();
+    }
+    engine.languages.clear();
+    if (engine.tesseract->Init(datapath.constData(), languages.constData()) != 0) {
+        qCWarning(SPECTACLE_LOG) << "Failed to initialize Tesseract with languages:" << languages;
+        return nullptr;
+    }
+    engine.tesseract->SetPageSegMode(pageSegMode);
+    engine.languages = languages;
+    return engine.tesseract;
+}
 
+void OcrWorker::discoverLanguages()
+{
+    QMutexLocker locker(&m_mutex);
+
+    QString datapath;
+    QStringList languages;
     try {
-        QImage rgbImage = image.convertToFormat(QImage::Format_RGB888);
+        TessBaseAPI tesseract;
+        if (tesseract.Init(nullptr, nullptr) != 0) {
+            qCWarning(SPECTACLE_LOG) << "Failed to initialize Tesseract OCR engine";
+            Q_EMIT languagesDiscovered(QString(), QStringList());
+            return;
+        }
 
-        tesseract->SetImage(rgbImage.bits(), rgbImage.width(), rgbImage.height(), 3, rgbImage.bytesPerLine());
+        const char *tessdataPath = tesseract.GetDatapath();
+        datapath = tessdataPath ? QString::fromUtf8(tessdataPath) : QString();
+        std::vector<std::string> names;
+        tesseract.GetAvailableLanguagesAsVector(&names);
+        tesseract.End();
 
-        if (tesseract->Recognize(nullptr) != 0) {
-            Q_EMIT imageProcessed(QString(), false);
+        if (datapath.isEmpty()) {
+            qCWarning(SPECTACLE_LOG) << "Tesseract datapath is empty";
+            Q_EMIT languagesDiscovered(QString(), QStringList());
             return;
         }
 
-        QStringList lines;
-        TessResultIterator *iterator = tesseract->GetIterator();
+        // List the directory once instead of checking for every language's file.
+        QSet<QString> trainedDataFiles;
+        const QDir dir(datapath);
+        QDirIterator it(datapath, {u"*.traineddata"_s}, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            trainedDataFiles.insert(dir.relativeFilePath(it.next()));
+        }
+
+        for (const auto &name : names) {
+            const QString langCode = QString::fromUtf8(name);
+            if (langCode.isEmpty() || languages.contains(langCode)) {
+                continue;
+            }
+            if (!trainedDataFiles.contains(langCode + u".traineddata"_s)) {
+                qCDebug(SPECTACLE_LOG) << "Skipping OCR language" << langCode << "- missing traineddata in" << datapath;
+                continue;
+            }
+            languages.append(langCode);
+        }
+        std::sort(languages.begin(), languages.end());
+    } catch (const std::exception &e) {
+        qCWarning(SPECTACLE_LOG) << "Exception during Tesseract initialization:" << e.what();
+        languages.clear();
+    }
 
-        if (iterator) {
-            do {
-                char *lineText = iterator->GetUTF8Text(tesseract::RIL_TEXTLINE);
-                if (lineText != nullptr) {
-                    QString line = QString::fromUtf8(lineText).trimmed();
-                    if (!line.isEmpty()) {
-                        lines.append(line);
+    Q_EMIT languagesDiscovered(datapath, languages);
+}
+
+bool OcrWorker::recognizeBlocks(quint64 requestId, const QImage &image, const QList<QRect> &blocks, qreal scale, EngineSet &engines, OcrResult &result)
+{
+    const int engineCount = std::min<int>(m_threadPool.maxThreadCount(), blocks.size());
+    if (engines.pool.size() < size_t(engineCount)) {
+        engines.pool.resize(engineCount);
+    }
+
+    // Each engine takes every engineCount-th block, so engines are never used by two threads at once.
+    std::vector<OcrResult> blockResults(blocks.size());
+    std::atomic_bool failed = false;
+    for (int engineIndex = 0; engineIndex < engineCount; ++engineIndex) {
+        m_threadPool.start([&, engineIndex] {
+            try {
+                // Each block is recognized on its own, so don't segment it into more blocks again.
+                const bool loadsLanguageData = engines.pool[engineIndex].languages != engines.languages;
+                auto engine = initializedEngine(engines.pool[engineIndex], engines.datapath, engines.languages, tesseract::PSM_SINGLE_BLOCK);
+                if (!engine) {
+                    failed = true;
+                    return;
+                }
+                if (loadsLanguageData) {
+                    Q_EMIT engineInitialized(requestId);
+                }
+                for (qsizetype i = engineIndex; i < blocks.size() && !failed; i += engineCount) {
+                    // Keep a small margin, so glyphs touching the block edges are recognized.
+                    const auto rect = blocks[i].adjusted(-4, -4, 4, 4).intersected(image.rect());
+                    const QImage blockImage = image.copy(rect);
+                    engine->SetImage(blockImage.constBits(), blockImage.width(), blockImage.height(), 1, blockImage.bytesPerLine());
+                    engine->SetSourceResolution(m_preprocessor.resolution());
+                    if (!recognize(engine, rect.topLeft(), scale, blockResults[i])) {
+                        failed = true;
                     }
-                    delete [] lineText;
                 }
-            } while (iterator->Next(tesseract::RIL_TEXTLINE) != 0);
-            delete iterator;
+                engine->Clear();
+            } catch (const std::exception &e) {
+                qCWarning(SPECTACLE_LOG) << "Exception in pooled OCR engine:" << e.what();
+                failed = true;
+            }
+        });
+    }
+    m_threadPool.waitForDone();
+    if (failed) {
+        return false;
+    }
+
+    for (const auto &blockResult : blockResults) {
+        result.append(blockResult);
+    }
+    return true;
+}
+
+void OcrWorker::processImage(quint64 requestId, const QImage &image, const QString &datapath, const QString &languages)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (image.isNull()) {
+        Q_EMIT imageProcessed(requestId, OcrResult(), false);
+        return;
+    }
+
+    try {
+        // Language data is only loaded if there are no cached engines for these languages.
+        auto &engines = engineSet(datapath, languages);
+        const bool loadsLanguageData = engines.engine.languages != engines.languages;
+        auto engine = initializedEngine(engines.engine, engines.datapath, engines.languages, tesseract::PSM_AUTO);
+        if (!engine) {
+            releaseEngines(engines);
+            m_engineSets.pop_front();
+            Q_EMIT imageProcessed(requestId, OcrResult(), false);
+            return;
+        }
+        if (loadsLanguageData) {
+            Q_EMIT engineInitialized(requestId);
+        }
+
+        // Tesseract copies the image, so the preprocessor's buffer can be reused right away.
+        const QImage &grayImage = m_preprocessor.process(image);
+
+        engine->SetImage(grayImage.constBits(), grayImage.width(), grayImage.height(), 1, grayImage.bytesPerLine());
+        engine->SetSourceResolution(m_preprocessor.resolution());
+
+        // Splitting small images isn't worth initializing more engines for.
+        // Use the size of the capture, so the threshold doesn't depend on upscaling.
+        const bool canSplit = m_threadPool.maxThreadCount() > 1 && qint64(image.width()) * image.height() >= 1024 * 768;
+        const auto blocks = canSplit ? textBlocks(engine) : QList<QRect>();
+
+        // Rectangles are mapped back to the pixels of the original image.
+        const qreal scale = qreal(image.width()) / grayImage.width();
+        OcrResult result;
+        bool recognized = true;
+        if (blocks.size() > 1 && recognizeBlocks(requestId, grayImage, blocks, scale, engines, result)) {
+            qCDebug(SPECTACLE_LOG) << "Recognized" << blocks.size() << "text blocks in parallel";
+        } else {
+            recognized = recognize(engine, QPoint(), scale, result);
+        }
+        engine->Clear();
+        trimEngineCache();
+        if (!recognized) {
+            Q_EMIT imageProcessed(requestId, OcrResult(), false);
+            return;
         }
 
-        const QString result = lines.join(QLatin1Char('\n')).trimmed();
-        Q_EMIT imageProcessed(result, true);
+        Q_EMIT imageProcessed(requestId, result, true);
     } catch (const std::exception &e) {
         qCWarning(SPECTACLE_LOG) << "Exception in OCR worker:" << e.what();
-        Q_EMIT imageProcessed(QString(), false);
+        Q_EMIT imageProcessed(requestId, OcrResult(), false);
     }
 }
 
@@ -7,37 +7,113 @@
 #pragma once
 
 #include "Config.h"
+#include "OcrPreprocessor.h"
+#include "OcrResult.h"
+#include "OcrResultModel.h"
 
+#include <QCache>
+#include <QHash>
 #include <QImage>
 #include <QMap>
 #include <QMutex>
 #include <QObject>
+#include <QRect>
 #include <QString>
 #include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 
+#include <list>
 #include <memory>
+#include <vector>
 
 #include <tesseract/capi.h>
 
 /**
  * @brief Worker class for OCR processing in background thread
+ *
+ * Engines are created and initialized on the worker thread when they are first used.
+ * Images are converted to binarized grayscale by OcrPreprocessor first.
+ * Large images are split into text blocks with a layout analysis pass of the given engine.
+ * The blocks are recognized in parallel by a pool of engines that use the same languages
+ * and are merged again in reading order.
+ * Results contain the rectangles of every word, line and block in the pixels of the given image.
  */
 class OcrWorker : public QObject
 {
     Q_OBJECT
 
 public:
+    static constexpr int MAX_OCR_ENGINES = 4;
+    // Engines for this many language combinations are kept initialized, if they fit in MAX_ENGINE_CACHE_SIZE.
+    // Pooled engines of the current combination are released too if they don't fit.
+    static constexpr int MAX_CACHED_LANGUAGE_SETS = 4;
+    static constexpr qint64 MAX_ENGINE_CACHE_SIZE = 384 * 1024 * 1024;
+
     explicit OcrWorker(QObject *parent = nullptr);
+    ~OcrWorker() override;
+
+    /**
+     * Recognize blocks with up to @p count engines at once.
+     * Defaults to the number of cores, up to MAX_OCR_ENGINES. Blocks aren't split with 1.
+     */
+    void setMaxEngineCount(int count);
 
 public Q_SLOTS:
-    void processImage(const QImage &image, TessBaseAPI *tesseract);
+    /**
+     * Recognize the text in @p image. Emits imageProcessed() with @p requestId when done.
+     */
+    void processImage(quint64 requestId, const QImage &image, const QString &datapath, const QString &languages);
+
+    /**
+     * Find the tessdata directory and the languages that have language data in it.
+     * Emits languagesDiscovered(), with an empty list if Tesseract isn't usable.
+     */
+    void discoverLanguages();
 
 Q_SIGNALS:
-    void imageProcessed(const QString &text, bool success);
+    void imageProcessed(quint64 requestId, const OcrResult &result, bool success);
+    /**
+     * Emitted whenever an engine loaded language data for @p requestId, which can take seconds.
+     */
+    void engineInitialized(quint64 requestId);
+    void languagesDiscovered(const QString &datapath, const QStringList &languages);
 
 private:
+    struct Engine {
+        TessBaseAPI *tesseract = nullptr;
+        QByteArray languages;
+    };
+
+    // Engines for one language combination.
+    struct EngineSet {
+        QByteArray datapath;
+        QByteArray languages;
+        // Estimated memory use of one engine, from the size of the language data.
+        qint64 engineSize = 0;
+        // Used for layout analysis and for images that aren't split into blocks.
+        Engine engine;
+        // Used to recognize blocks in parallel.
+        std::vector<Engine> pool;
+    };
+
+    // Rectangles are moved by offset and then scaled.
+    static bool recognize(TessBaseAPI *tesseract, const QPoint &offset, qreal scale, OcrResult &result);
+    static QList<QRect> textBlocks(TessBaseAPI *tesseract);
+    bool recognizeBlocks(quint64 requestId, const QImage &image, const QList<QRect> &blocks, qreal scale, EngineSet &engines, OcrResult &result);
+    static TessBaseAPI *
+    initializedEngine(Engine &engine, const QByteArray &datapath, const QByteArray &languages, tesseract::PageSegMode pageSegMode);
+    static void releaseEngine(Engine &engine);
+    static void releaseEngines(EngineSet &engines);
+    static qint64 cacheSize(const EngineSet &engines);
+    EngineSet &engineSet(const QString &datapath, const QString &languages);
+    void trimEngineCache();
+
     QMutex m_mutex;
+    OcrPreprocessor m_preprocessor;
+    // Most recently used first, so switching between a few language combinations doesn't reload language data.
+    std::list<EngineSet> m_engineSets;
+    QThreadPool m_threadPool;
 };
 
 /**
@@ -51,6 +127,7 @@ class OcrManager : public QObject
 public:
     static constexpr int MAX_OCR_LANGUAGES = 4;
     static constexpr int MIN_OCR_LANGUAGES = 1;
+    static constexpr int MAX_CACHED_RESULTS = 8;
     enum class OcrStatus {
         Ready = 0,
         Processing = 1,
@@ -66,6 +143,9 @@ public:
     /**
      * @brief Check if OCR engine is available and properly initialized
      * @return true if OCR is available, false otherwise
+     *
+     * Availability is determined asynchronously after startup, and statusChanged()
+     * is emitted when it is known. Language data is only loaded when text is recognized.
      */
     bool isAvailable() const;
 
@@ -75,6 +155,13 @@ public:
      */
     OcrStatus status() const;
 
+    /**
+     * @brief The words, lines and blocks of the last successful recognition
+     *
+     * Use it to get the text of a region or to find text without recognizing the image again.
+     */
+    OcrResultModel *resultModel() const;
+
     /**
      * @brief Get a map of available languages with human-readable names
      * @return QMap where key is language code and value is display name
@@ -125,19 +212,24 @@ Q_SIGNALS:
     void textRecognized(const QString &text, const QStringList &languageCodes, bool success);
 
     /**
-     * @brief Emitted when OCR status changes
+     * @brief Emitted when OCR status or availability changes
      * @param status New status
      */
     void statusChanged(OcrStatus status);
 
 private Q_SLOTS:
-    void handleRecognitionComplete(const QString &text, bool success);
+    void handleRecognitionComplete(quint64 requestId, const OcrResult &result, bool success);
+    void handleLanguagesDiscovered(const QString &datapath, const QStringList &languages);
 
 private:
-    void initializeTesseract();
+    void initializeLanguages();
+    /**
+     * Use the languages found by an earlier discovery if the tessdata directory hasn't changed since.
+     */
+    bool loadLanguageIndex();
+    void applyLanguageIndex(const QString &datapath, const QStringList &languages);
     void setStatus(OcrStatus status);
-    bool setupTesseractLanguages(const QStringList &langCodes);
-    void setupAvailableLanguages(const QString &tessdataPath);
+    void setupAvailableLanguages(const QStringList &languages);
     void loadSavedLanguageSetting();
     bool isLanguageAvailable(const QString &languageCode) const;
     QString tesseractLangName(const QString &tesseractCode) const;
@@ -152,12 +244,12 @@ private:
 
     static OcrManager *s_instance;
 
-    TessBaseAPI *m_tesseract;
     OcrWorker *m_worker;
     std::unique_ptr<QThread> m_workerThread;
     QTimer *m_timeoutTimer;
 
     OcrStatus m_status;
+    QString m_datapath;
     QString m_currentLanguageCode;
     QStringList m_configuredLanguages;
     QStringList m_activeLanguages;
@@ -166,6 +258,13 @@ private:
     QMap<QString, QString> m_languageNames;
     bool m_configSyncSuspended = false;
     bool m_initialized;
+    OcrResultModel *m_resultModel;
+    // Results by image cache key and languages.
+    using ResultKey = std::pair<qint64, QString>;
+    QCache<ResultKey, OcrResult> m_resultCache;
+    // Only the result of the last request is shown. Earlier ones are still cached.
+    quint64 m_lastRequestId = 0;
+    QHash<quint64, ResultKey> m_pendingResultKeys;
 
 private:
 };
@@ -0,0 +1,187 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "OcrPreprocessor.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Don't upscale images that would have more pixels than this. Large images usually have enough
+// pixels per glyph already, and Tesseract gets slower with every pixel.
+static constexpr qint64 s_maxUpscaledPixels = 4096 * 4096;
+
+// How much darker than the local mean a pixel has to be to become black.
+static constexpr quint32 s_thresholdPercent = 15;
+
+bool OcrPreprocessor::isUpscaleEnabled() const
+{
+    return m_upscaleEnabled;
+}
+
+void OcrPreprocessor::setUpscaleEnabled(bool enabled)
+{
+    m_upscaleEnabled = enabled;
+}
+
+bool OcrPreprocessor::isBinarizationEnabled() const
+{
+    return m_binarizationEnabled;
+}
+
+void OcrPreprocessor::setBinarizationEnabled(bool enabled)
+{
+    m_binarizationEnabled = enabled;
+}
+
+int OcrPreprocessor::resolution() const
+{
+    return m_resolution;
+}
+
+const QImage &OcrPreprocessor::process(const QImage &image)
+{
+    if (image.isNull()) {
+        m_grayImage = QImage();
+        return m_grayImage;
+    }
+
+    toGrayscale(image);
+
+    const qreal dpr = std::max<qreal>(image.devicePixelRatio(), 1);
+    const bool scale = m_upscaleEnabled && dpr < 1.5 && qint64(image.width()) * image.height() * 4 <= s_maxUpscaledPixels;
+    if (scale) {
+        upscale2x();
+    }
+    QImage &result = scale ? m_scaledImage : m_grayImage;
+    m_resolution = qRound(96 * dpr * (scale ? 2 : 1));
+
+    if (m_binarizationEnabled) {
+        // The window should be about twice as high as a line of UI text.
+        binarize(result, std::clamp(qRound(12 * m_resolution / 96.0), 8, 48));
+    }
+    return result;
+}
+
+void OcrPreprocessor::toGrayscale(const QImage &image)
+{
+    // Premultiplied, so transparent pixels can be put on a white background without a division.
+    const QImage source = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const int width = source.width();
+    const int height = source.height();
+    if (m_grayImage.size() != source.size()) {
+        m_grayImage = QImage(source.size(), QImage::Format_Grayscale8);
+    }
+
+    quint64 total = 0;
+    for (int y = 0; y < height; ++y) {
+        const auto in = reinterpret_cast<const QRgb *>(source.constScanLine(y));
+        uchar *out = m_grayImage.scanLine(y);
+        quint32 rowTotal = 0;
+        // Plain integer math without branches, so this can be vectorized.
+        for (int x = 0; x < width; ++x) {
+            const quint32 pixel = in[x];
+            // Rec. 601 luma with 8 bit fixed point weights.
+            const quint32 luma = ((pixel >> 16 & 0xff) * 77 + (pixel >> 8 & 0xff) * 150 + (pixel & 0xff) * 29 + 128) >> 8;
+            const quint32 value = std::min<quint32>(luma + 255 - (pixel >> 24), 255);
+            out[x] = value;
+            rowTotal += value;
+        }
+        total += rowTotal;
+    }
+
+    // Tesseract expects dark text on a light background, so invert dark themes.
+    if (total < quint64(width) * height * 128) {
+        for (int y = 0; y < height; ++y) {
+            uchar *line = m_grayImage.scanLine(y);
+            for (int x = 0; x < width; ++x) {
+                line[x] = 255 - line[x];
+            }
+        }
+    }
+}
+
+// Bilinear 2x upscale with pixel centers aligned, so every output pixel is 3/4 of the
+// nearest source pixel and 1/4 of the next nearest one in each direction.
+void OcrPreprocessor::upscale2x()
+{
+    const int width = m_grayImage.width();
+    const int height = m_grayImage.height();
+    const QSize size(width * 2, height * 2);
+    if (m_scaledImage.size() != size) {
+        m_scaledImage = QImage(size, QImage::Format_Grayscale8);
+    }
+
+    m_rows.resize(width);
+    uchar *blended = m_rows.data();
+    for (int y = 0; y < height; ++y) {
+        const uchar *row = m_grayImage.constScanLine(y);
+        for (int half = 0; half < 2; ++half) {
+            const uchar *neighbor = m_grayImage.constScanLine(std::clamp(half == 0 ? y - 1 : y + 1, 0, height - 1));
+            for (int x = 0; x < width; ++x) {
+                blended[x] = (3 * row[x] + neighbor[x] + 2) >> 2;
+            }
+            uchar *out = m_scaledImage.scanLine(2 * y + half);
+            for (int x = 0; x < width; ++x) {
+                const int left = blended[std::max(x - 1, 0)];
+                const int right = blended[std::min(x + 1, width - 1)];
+                out[2 * x] = (3 * blended[x] + left + 2) >> 2;
+                out[2 * x + 1] = (3 * blended[x] + right + 2) >> 2;
+            }
+        }
+    }
+}
+
+// Bradley's adaptive threshold: pixels that are darker than the mean of the surrounding
+// window by more than s_thresholdPercent become black, everything else becomes white.
+// Window sums come from running column sums, so only radius + 1 original rows have to be kept
+// while the image is overwritten in place.
+void OcrPreprocessor::binarize(QImage &image, int radius)
+{
+    const int width = image.width();
+    const int height = image.height();
+    const int savedRows = radius + 1;
+    m_columnSums.assign(width, 0);
+    m_rows.resize(size_t(width) * savedRows);
+    quint32 *columnSums = m_columnSums.data();
+
+    auto addRow = [&](const uchar *row) {
+        for (int x = 0; x < width; ++x) {
+            columnSums[x] += row[x];
+        }
+    };
+    for (int y = 0; y < std::min(radius, height); ++y) {
+        addRow(image.constScanLine(y));
+    }
+
+    for (int y = 0; y < height; ++y) {
+        if (y + radius < height) {
+            addRow(image.constScanLine(y + radius));
+        }
+        // Row y - radius - 1 has already been binarized, so use the copy made before that.
+        uchar *savedRow = m_rows.data() + size_t(y % savedRows) * width;
+        if (y - radius - 1 >= 0) {
+            for (int x = 0; x < width; ++x) {
+                columnSums[x] -= savedRow[x];
+            }
+        }
+        uchar *row = image.scanLine(y);
+        std::memcpy(savedRow, row, width);
+
+        const quint32 rowCount = std::min(y + radius, height - 1) - std::max(y - radius, 0) + 1;
+        quint32 sum = 0;
+        for (int x = 0; x < std::min(radius, width); ++x) {
+            sum += columnSums[x];
+        }
+        for (int x = 0; x < width; ++x) {
+            if (x + radius < width) {
+                sum += columnSums[x + radius];
+            }
+            if (x - radius - 1 >= 0) {
+                sum -= columnSums[x - radius - 1];
+            }
+            const quint32 count = (std::min(x + radius, width - 1) - std::max(x - radius, 0) + 1) * rowCount;
+            row[x] = row[x] * count * 100 < sum * (100 - s_thresholdPercent) ? 0 : 255;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <QImage>
+
+#include <vector>
+
+/**
+ * Prepares screenshots for Tesseract.
+ *
+ * Images are converted to 8-bit grayscale with dark backgrounds inverted, optionally
+ * upscaled and binarized with an adaptive threshold. Everything happens in buffers
+ * owned by the preprocessor, so keep an instance around to reuse them.
+ */
+class OcrPreprocessor
+{
+public:
+    /**
+     * Whether images with a device pixel ratio below 1.5 are upscaled 2x.
+     * Tesseract is most accurate when glyphs are about 20 to 30 pixels high, but this
+     * makes a 1080p capture 4 times as large, so it is off by default.
+     */
+    bool isUpscaleEnabled() const;
+    void setUpscaleEnabled(bool enabled);
+
+    /**
+     * Whether the grayscale image is binarized with a local mean threshold.
+     */
+    bool isBinarizationEnabled() const;
+    void setBinarizationEnabled(bool enabled);
+
+    /**
+     * Returns the preprocessed Format_Grayscale8 image.
+     * It shares the preprocessor's buffer, so it is only valid until the next call.
+     */
+    const QImage &process(const QImage &image);
+
+    /**
+     * The estimated resolution of the last processed image in DPI, for TessBaseAPI::SetSourceResolution().
+     */
+    int resolution() const;
+
+private:
+    void toGrayscale(const QImage &image);
+    void upscale2x();
+    void binarize(QImage &image, int radius);
+
+    bool m_upscaleEnabled = false;
+    bool m_binarizationEnabled = true;
+    int m_resolution = 96;
+    QImage m_grayImage;
+    QImage m_scaledImage;
+    std::vector<quint32> m_columnSums;
+    std::vector<uchar> m_rows;
+};
@@ -0,0 +1,78 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "OcrResult.h"
+
+#include <numeric>
+
+QString OcrResult::text() const
+{
+    QList<int> wordIndexes(words.size());
+    std::iota(wordIndexes.begin(), wordIndexes.end(), 0);
+    return joinedText(wordIndexes);
+}
+
+QString OcrResult::text(const QRectF &rect) const
+{
+    QList<int> wordIndexes;
+    for (int i = 0; i < words.size(); ++i) {
+        if (rect.contains(words[i].rect.center())) {
+            wordIndexes.append(i);
+        }
+    }
+    return joinedText(wordIndexes);
+}
+
+QList<int> OcrResult::find(const QString &text) const
+{
+    QList<int> wordIndexes;
+    if (text.isEmpty()) {
+        return wordIndexes;
+    }
+    for (int i = 0; i < words.size(); ++i) {
+        if (words[i].text.contains(text, Qt::CaseInsensitive)) {
+            wordIndexes.append(i);
+        }
+    }
+    return wordIndexes;
+}
+
+void OcrResult::append(const OcrResult &other)
+{
+    const int wordOffset = words.size();
+    const int lineOffset = lines.size();
+    const int blockOffset = blocks.size();
+    words.reserve(words.size() + other.words.size());
+    for (auto word : other.words) {
+        word.line += lineOffset;
+        words.append(word);
+    }
+    lines.reserve(lines.size() + other.lines.size());
+    for (auto line : other.lines) {
+        line.block += blockOffset;
+        line.firstWord += wordOffset;
+        lines.append(line);
+    }
+    blocks.reserve(blocks.size() + other.blocks.size());
+    for (auto block : other.blocks) {
+        block.firstLine += lineOffset;
+        blocks.append(block);
+    }
+}
+
+// Word indexes must be in ascending order.
+QString OcrResult::joinedText(const QList<int> &wordIndexes) const
+{
+    QString result;
+    int previousLine = -1;
+    for (int i : wordIndexes) {
+        const auto &word = words[i];
+        if (!result.isEmpty()) {
+            result += word.line == previousLine ? u' ' : u'\n';
+        }
+        result += word.text;
+        previousLine = word.line;
+    }
+    return result;
+}
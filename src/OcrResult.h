@@ -0,0 +1,70 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <QList>
+#include <QMetaType>
+#include <QRectF>
+#include <QString>
+
+/**
+ * The words, lines and blocks that were recognized in an image.
+ *
+ * Rectangles are in the pixel coordinates of the recognized image, not logical coordinates.
+ * Lines and blocks refer to consecutive ranges of words and lines, in reading order.
+ */
+struct OcrResult {
+    struct Word {
+        QString text;
+        QRectF rect;
+        // From 0 to 100.
+        float confidence = 0;
+        int line = -1;
+    };
+
+    struct Line {
+        QRectF rect;
+        float confidence = 0;
+        int block = -1;
+        int firstWord = 0;
+        int wordCount = 0;
+    };
+
+    struct Block {
+        QRectF rect;
+        float confidence = 0;
+        int firstLine = 0;
+        int lineCount = 0;
+    };
+
+    QList<Word> words;
+    QList<Line> lines;
+    QList<Block> blocks;
+
+    /**
+     * All lines joined with newlines, with the words of a line separated by spaces.
+     */
+    QString text() const;
+
+    /**
+     * The text of the words whose center is inside @p rect, with the same line breaks as text().
+     */
+    QString text(const QRectF &rect) const;
+
+    /**
+     * The indexes of the words that contain @p text, ignoring case.
+     */
+    QList<int> find(const QString &text) const;
+
+    /**
+     * Add the words, lines and blocks of @p other after the ones in this result.
+     */
+    void append(const OcrResult &other);
+
+private:
+    QString joinedText(const QList<int> &wordIndexes) const;
+};
+
+Q_DECLARE_METATYPE(OcrResult)
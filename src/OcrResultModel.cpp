@@ -0,0 +1,82 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "OcrResultModel.h"
+
+using namespace Qt::StringLiterals;
+
+OcrResultModel::OcrResultModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+    m_roleNames[Qt::DisplayRole] = "display"_ba;
+    m_roleNames[RectRole] = "rect"_ba;
+    m_roleNames[ConfidenceRole] = "confidence"_ba;
+    m_roleNames[LineRole] = "line"_ba;
+    m_roleNames[BlockRole] = "block"_ba;
+}
+
+const OcrResult &OcrResultModel::result() const
+{
+    return m_result;
+}
+
+void OcrResultModel::setResult(const OcrResult &result)
+{
+    beginResetModel();
+    m_result = result;
+    endResetModel();
+    Q_EMIT countChanged();
+}
+
+QString OcrResultModel::text() const
+{
+    return m_result.text();
+}
+
+QString OcrResultModel::textInRect(const QRectF &rect) const
+{
+    return m_result.text(rect);
+}
+
+QList<QRectF> OcrResultModel::find(const QString &text) const
+{
+    QList<QRectF> rects;
+    for (int i : m_result.find(text)) {
+        rects.append(m_result.words[i].rect);
+    }
+    return rects;
+}
+
+QHash<int, QByteArray> OcrResultModel::roleNames() const
+{
+    return m_roleNames;
+}
+
+QVariant OcrResultModel::data(const QModelIndex &index, int role) const
+{
+    if (!checkIndex(index, CheckIndexOption::IndexIsValid)) {
+        return {};
+    }
+    const auto &word = m_result.words.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        return word.text;
+    case RectRole:
+        return word.rect;
+    case ConfidenceRole:
+        return word.confidence;
+    case LineRole:
+        return word.line;
+    case BlockRole:
+        return m_result.lines.at(word.line).block;
+    }
+    return {};
+}
+
+int OcrResultModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_result.words.size();
+}
+
+#include "moc_OcrResultModel.cpp"
@@ -0,0 +1,59 @@
+/* SPDX-FileCopyrightText: 2026 agent <agent@local>
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include "OcrResult.h"
+
+#include <QAbstractListModel>
+#include <QQmlEngine>
+
+/**
+ * The words of the last OCR result, so that text can be selected, searched and highlighted
+ * without recognizing the image again.
+ */
+class OcrResultModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Use SpectacleCore.ocrResult")
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged FINAL)
+    Q_PROPERTY(QString text READ text NOTIFY countChanged FINAL)
+
+public:
+    explicit OcrResultModel(QObject *parent = nullptr);
+
+    enum {
+        RectRole = Qt::UserRole + 1,
+        ConfidenceRole = Qt::UserRole + 2,
+        LineRole = Qt::UserRole + 3,
+        BlockRole = Qt::UserRole + 4,
+    };
+
+    const OcrResult &result() const;
+    void setResult(const OcrResult &result);
+
+    QString text() const;
+
+    /**
+     * The text inside @p rect, in image pixel coordinates.
+     */
+    Q_INVOKABLE QString textInRect(const QRectF &rect) const;
+
+    /**
+     * The rectangles of the words that contain @p text, for highlighting matches.
+     */
+    Q_INVOKABLE QList<QRectF> find(const QString &text) const;
+
+    QHash<int, QByteArray> roleNames() const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+
+Q_SIGNALS:
+    void countChanged();
+
+private:
+    OcrResult m_result;
+    QHash<int, QByteArray> m_roleNames;
+};
@@ -10,4 +10,16 @@ ImagePlatform::ImagePlatform(QObject *parent)
 {
 }
 
+int ImagePlatform::minimumCaptureDelay() const
+{
+    return 0;
+}
+
+void ImagePlatform::doGrabArea(const QRect &area, bool includePointer)
+{
+    Q_UNUSED(area)
+    Q_UNUSED(includePointer)
+    Q_EMIT newScreenshotFailed();
+}
+
 #include "moc_ImagePlatform.cpp"
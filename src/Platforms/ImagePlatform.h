@@ -24,14 +24,15 @@ class ImagePlatform : public QObject
 
 public:
     enum GrabMode {
-        NoGrabModes =           0b0000000,
-        AllScreens =            0b0000001,
-        CurrentScreen =         0b0000010,
-        ActiveWindow =          0b0000100,
-        WindowUnderCursor =     0b0001000,
-        TransientWithParent =   0b0010000,
-        AllScreensScaled =      0b0100000,
-        PerScreenImageNative =  0b1000000,
+        NoGrabModes =           0b00000000,
+        AllScreens =            0b00000001,
+        CurrentScreen =         0b00000010,
+        ActiveWindow =          0b00000100,
+        WindowUnderCursor =     0b00001000,
+        TransientWithParent =   0b00010000,
+        AllScreensScaled =      0b00100000,
+        PerScreenImageNative =  0b01000000,
+        Area =                  0b10000000, //< Only the area passed to doGrabArea()
     };
     Q_DECLARE_FLAGS(GrabModes, GrabMode)
     Q_FLAG(GrabModes)
@@ -46,10 +47,23 @@ public:
     virtual GrabModes supportedGrabModes() const = 0;
     virtual ShutterModes supportedShutterModes() const = 0;
 
+    /**
+     * The shortest delay in milliseconds before an immediate grab, so that Spectacle's own
+     * windows have disappeared and the platform is ready to capture.
+     */
+    virtual int minimumCaptureDelay() const;
+
 public Q_SLOTS:
     virtual void
     doGrab(ImagePlatform::ShutterMode shutterMode, ImagePlatform::GrabMode grabMode, bool includePointer, bool includeDecorations, bool includeShadow) = 0;
 
+    /**
+     * Grab only the given area of the workspace, in logical coordinates.
+     * This is much cheaper than grabbing every screen and cropping the result afterwards.
+     * Platforms that support this must add GrabMode::Area to supportedGrabModes().
+     */
+    virtual void doGrabArea(const QRect &area, bool includePointer);
+
 Q_SIGNALS:
     void supportedGrabModesChanged();
 
@@ -19,20 +19,32 @@
 #include <QDBusPendingCallWatcher>
 #include <QDBusReply>
 #include <QDBusUnixFileDescriptor>
+#include <QDeadlineTimer>
 #include <QFile>
 #include <QFileDevice>
 #include <QFuture>
 #include <QFutureWatcher>
 #include <QGuiApplication>
+#include <QHash>
 #include <QPainter>
 #include <QPixmap>
+#include <QPromise>
 #include <QScreen>
+#include <QRegion>
+#include <QThread>
 #include <QTimer>
+#include <QtConcurrentMap>
 #include <QtConcurrentRun>
 
+#include <chrono>
+#include <cstring>
+#include <thread>
+
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 using namespace Qt::StringLiterals;
@@ -62,6 +74,8 @@ static QVariantMap screenShotFlagsToVardict(ImagePlatformKWin::ScreenShotFlags f
     return options;
 }
 
+static constexpr auto s_combinedImageFormat = QImage::Format_RGBA8888_Premultiplied;
+
 QImage combinedImage(const QList<QImage> &images)
 {
     if (images.empty()) {
@@ -80,12 +94,11 @@ QImage combinedImage(const QList<QImage> &images)
         imageRect |= rect;
         geometryList << ImageMetaData::subGeometryPropertyMap(rect, dpr);
     }
-    static const auto finalFormat = QImage::Format_RGBA8888_Premultiplied;
     const bool allSameDpr = std::all_of(images.cbegin(), images.cend(), [maxDpr](const QImage &i){
         return i.devicePixelRatio() == maxDpr;
     });
     if (allSameDpr) {
-        QImage finalImage{imageRect.size().toSize() * maxDpr, finalFormat};
+        QImage finalImage{imageRect.size().toSize() * maxDpr, s_combinedImageFormat};
         QPainter painter(&finalImage);
         for (auto &image : images) {
             // Explicitly setting the position and size so that you don't need to read
@@ -103,7 +116,7 @@ QImage combinedImage(const QList<QImage> &images)
     }
     // We ceil to the next integer size up so that integer DPR images are always crisp.
     const auto finalDpr = std::ceil(maxDpr);
-    QImage finalImage{imageRect.size().toSize() * finalDpr, finalFormat};
+    QImage finalImage{imageRect.size().toSize() * finalDpr, s_combinedImageFormat};
     finalImage.fill(Qt::transparent);
     QPainter painter(&finalImage);
     for (auto &image : images) {
@@ -123,18 +136,18 @@ QImage combinedImage(const QList<QImage> &images)
     return finalImage;
 }
 
-static ResultVariant allocateImage(const QVariantMap &metadata)
+static QString validateImageMetadata(const QVariantMap &metadata, int &width, int &height, QImage::Format &format)
 {
     QString errors;
 
     bool ok;
     // We use int because QImage takes ints for its size
-    const int width = metadata.value(u"width"_s).toInt(&ok);
+    width = metadata.value(u"width"_s).toInt(&ok);
     if (!ok || width <= 0) {
         errors = i18nc("@info, %1 is the width", "Bad width for KWin screenshot: %1", QDebug::toString(metadata.value(u"width"_s)));
     }
 
-    const int height = metadata.value(u"height"_s).toInt(&ok);
+    height = metadata.value(u"height"_s).toInt(&ok);
     if (!ok || height <= 0) {
         const auto string = i18nc("@info, %1 is the height", "Bad height for KWin screenshot: %1", QDebug::toString(metadata.value(u"height"_s)));
         if (!errors.isEmpty()) {
@@ -145,8 +158,8 @@ static ResultVariant allocateImage(const QVariantMap &metadata)
     }
 
     // We use uint because QImage::Format values are all above 0.
-    const uint format = metadata.value(u"format"_s).toUInt(&ok);
-    if (!ok || format <= QImage::Format_Invalid || format >= QImage::NImageFormats) {
+    const uint formatValue = metadata.value(u"format"_s).toUInt(&ok);
+    if (!ok || formatValue <= QImage::Format_Invalid || formatValue >= QImage::NImageFormats) {
         const auto string = i18nc("@info, %1 is a file format like 'png', 'jpg'", "Bad format for KWin screenshot: %1", QDebug::toString(metadata.value(u"format"_s)));
         if (!errors.isEmpty()) {
             errors = errors % u"\n"_s % string;
@@ -154,26 +167,64 @@ static ResultVariant allocateImage(const QVariantMap &metadata)
             errors = string;
         }
     }
+    format = static_cast<QImage::Format>(formatValue);
+
+    return errors;
+}
 
+static ResultVariant allocateImage(const QVariantMap &metadata)
+{
+    int width = 0;
+    int height = 0;
+    QImage::Format format = QImage::Format_Invalid;
+    const QString errors = validateImageMetadata(metadata, width, height, format);
     return errors.isEmpty() //
-        ? ResultVariant{QImage{width, height, static_cast<QImage::Format>(format)}}
+        ? ResultVariant{QImage{width, height, format}}
         : ResultVariant{errors};
 }
 
-static ResultVariant readImage(int fileDescriptor, const QVariantMap &metadata)
+// Lookups of org.kde.KWin.getWindowInfo that are still in progress, so that captures of a window
+// that happen at the same time share one D-Bus round trip. Finished lookups aren't kept, since
+// there is no way to be notified about window changes on Wayland and the geometry may be outdated.
+// Only used from the main thread.
+static QHash<QString, QFuture<QVariantMap>> s_windowInfoLookups;
+
+static QFuture<QVariantMap> lookUpWindowInfo(const QString &windowId)
 {
-    QFile file;
-    if (!file.open(fileDescriptor, QFileDevice::ReadOnly, QFileDevice::AutoCloseHandle)) {
-        close(fileDescriptor);
-        return {i18nc("@info", "Could not open file descriptor for reading KWin screenshot.")};
+    if (windowId.isEmpty()) {
+        return {};
     }
-
-    ResultVariant result = allocateImage(metadata);
-    if (result.index() != ResultVariant::Image) {
-        return result;
+    auto it = s_windowInfoLookups.constFind(windowId);
+    if (it != s_windowInfoLookups.cend()) {
+        return *it;
     }
-    QImage &resultImage = std::get<ResultVariant::Image>(result);
 
+    QDBusMessage message = QDBusMessage::createMethodCall(u"org.kde.KWin"_s,
+                                                          u"/KWin"_s,
+                                                          u"org.kde.KWin"_s,
+                                                          u"getWindowInfo"_s);
+    message.setArguments({windowId});
+    auto promise = std::make_shared<QPromise<QVariantMap>>();
+    promise->start();
+    auto future = promise->future();
+    auto watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), qGuiApp);
+    QObject::connect(watcher, &QDBusPendingCallWatcher::finished, watcher, [watcher, promise, windowId] {
+        watcher->deleteLater();
+        s_windowInfoLookups.remove(windowId);
+        const QDBusPendingReply<QVariantMap> reply = *watcher;
+        if (reply.isValid()) {
+            promise->addResult(reply.value());
+        }
+        promise->finish();
+    });
+    s_windowInfoLookups.insert(windowId, future);
+    return future;
+}
+
+// Called on the thread reading the image. windowInfo is waited for here, so the D-Bus round trip
+// happens while the pixels are being read.
+static void setImageMetadata(QImage &resultImage, const QVariantMap &metadata, QFuture<QVariantMap> windowInfo)
+{
     bool ok = false;
     qreal scale = metadata.value(u"scale"_s).toReal(&ok);
     if (ok) {
@@ -191,16 +242,12 @@ static ResultVariant readImage(int fileDescriptor, const QVariantMap &metadata)
     // No point in storing the windowId in the image since it means nothing to users
     // and can't be used if the window is closed.
     if (!windowId.isEmpty()) {
-        QDBusMessage message = QDBusMessage::createMethodCall(u"org.kde.KWin"_s,
-                                                              u"/KWin"_s,
-                                                              u"org.kde.KWin"_s,
-                                                              u"getWindowInfo"_s);
-        message.setArguments({windowId});
-        const QDBusReply<QVariantMap> reply = QDBusConnection::sessionBus().call(message);
-        if (reply.isValid()) {
-            ImageMetaData::setWindowTitle(resultImage, reply.value().value(u"caption"_s).toString());
-            auto logicalX = Geometry::mapFromPlatformValue(reply.value().value(u"x"_s).toReal(), scale);
-            auto logicalY = Geometry::mapFromPlatformValue(reply.value().value(u"y"_s).toReal(), scale);
+        windowInfo.waitForFinished();
+        if (windowInfo.resultCount() > 0) {
+            const auto info = windowInfo.result();
+            ImageMetaData::setWindowTitle(resultImage, info.value(u"caption"_s).toString());
+            auto logicalX = Geometry::mapFromPlatformValue(info.value(u"x"_s).toReal(), scale);
+            auto logicalY = Geometry::mapFromPlatformValue(info.value(u"y"_s).toReal(), scale);
             ImageMetaData::setLogicalXY(resultImage, logicalX, logicalY);
         }
     }
@@ -219,20 +266,155 @@ static ResultVariant readImage(int fileDescriptor, const QVariantMap &metadata)
             }
         }
     }
+}
+
+static ResultVariant readImage(int fileDescriptor, const QVariantMap &metadata, QFuture<QVariantMap> windowInfo)
+{
+    QFile file;
+    if (!file.open(fileDescriptor, QFileDevice::ReadOnly, QFileDevice::AutoCloseHandle)) {
+        close(fileDescriptor);
+        return {i18nc("@info", "Could not open file descriptor for reading KWin screenshot.")};
+    }
+
+    ResultVariant result = allocateImage(metadata);
+    if (result.index() != ResultVariant::Image) {
+        return result;
+    }
+    QImage &resultImage = std::get<ResultVariant::Image>(result);
 
     QDataStream stream(&file);
     stream.readRawData(reinterpret_cast<char *>(resultImage.bits()), resultImage.sizeInBytes());
+    setImageMetadata(resultImage, metadata, windowInfo);
 
     return result;
 }
 
+#ifdef MFD_ALLOW_SEALING
+struct MappedImageData {
+    void *address = MAP_FAILED;
+    size_t length = 0;
+};
+
+static void unmapImageData(void *info)
+{
+    auto data = static_cast<MappedImageData *>(info);
+    munmap(data->address, data->length);
+    delete data;
+}
+
+// KWin replies before it is done writing the image. read() on a pipe blocks until the data
+// arrives, but a memfd has nothing like that, so wait until the file has reached its final size.
+static bool waitForFileSize(int fileDescriptor, off_t size)
+{
+    QDeadlineTimer deadline(4000);
+    std::chrono::microseconds interval{50};
+    struct stat fileStat;
+    while (fstat(fileDescriptor, &fileStat) == 0) {
+        if (fileStat.st_size >= size) {
+            return true;
+        }
+        if (deadline.hasExpired()) {
+            return false;
+        }
+        std::this_thread::sleep_for(interval);
+        interval = std::min(interval * 2, std::chrono::microseconds{2000});
+    }
+    return false;
+}
+
+static ResultVariant mapImage(int fileDescriptor, const QVariantMap &metadata, QFuture<QVariantMap> windowInfo)
+{
+    int width = 0;
+    int height = 0;
+    QImage::Format format = QImage::Format_Invalid;
+    const QString errors = validateImageMetadata(metadata, width, height, format);
+    if (!errors.isEmpty()) {
+        close(fileDescriptor);
+        return {errors};
+    }
+
+    // KWin writes the bytes of a QImage, so rows are 32-bit aligned unless it tells us otherwise.
+    const int depth = QImage::toPixelFormat(format).bitsPerPixel();
+    qsizetype bytesPerLine = ((qsizetype(width) * depth + 31) >> 5) << 2;
+    bool ok = false;
+    const qsizetype stride = metadata.value(u"stride"_s).toLongLong(&ok);
+    if (ok && stride >= bytesPerLine) {
+        bytesPerLine = stride;
+    }
+    const size_t length = bytesPerLine * height;
+
+    if (!waitForFileSize(fileDescriptor, length)) {
+        close(fileDescriptor);
+        return {i18nc("@info", "Timed out while waiting for KWin to write the screenshot.")};
+    }
+
+    // Shrinking the file while it is mapped would crash us with SIGBUS, so only map it once it
+    // can't change size anymore. Sealing writes fails if KWin still has the file mapped.
+    const bool sealed = fcntl(fileDescriptor, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0
+        || fcntl(fileDescriptor, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0;
+    void *address = sealed ? mmap(nullptr, length, PROT_READ, MAP_SHARED, fileDescriptor, 0) : MAP_FAILED;
+    if (address == MAP_FAILED) {
+        Log::debug() << "Could not map KWin screenshot memfd, copying it instead:" << QString::fromLocal8Bit(strerror(errno));
+        ResultVariant result = allocateImage(metadata);
+        if (result.index() != ResultVariant::Image) {
+            close(fileDescriptor);
+            return result;
+        }
+        QImage &resultImage = std::get<ResultVariant::Image>(result);
+        // KWin's stride can be larger than ours, so copy one row at a time.
+        const auto rowLength = std::min<qsizetype>(bytesPerLine, resultImage.bytesPerLine());
+        for (int y = 0; y < height; ++y) {
+            const auto bytesRead = pread(fileDescriptor, resultImage.scanLine(y), rowLength, off_t(y) * bytesPerLine);
+            if (bytesRead != rowLength) {
+                const auto errnum = errno;
+                close(fileDescriptor);
+                if (bytesRead < 0) {
+                    return {i18nc("@info, %1 is an error code", "Could not read KWin screenshot: %1", QString::fromLocal8Bit(strerror(errnum)))};
+                }
+                return {i18nc("@info", "KWin screenshot is incomplete.")};
+            }
+        }
+        close(fileDescriptor);
+        setImageMetadata(resultImage, metadata, windowInfo);
+        return result;
+    }
+    // The mapping keeps the memory alive after the file descriptor is closed.
+    close(fileDescriptor);
+
+    // The image is read-only, so anything that wants to modify it will detach from the mapping.
+    QImage resultImage(static_cast<const uchar *>(address), width, height, bytesPerLine, format, unmapImageData, new MappedImageData{address, length});
+    setImageMetadata(resultImage, metadata, windowInfo);
+    return {resultImage};
+}
+#endif
+
+static int createMemFd()
+{
+#ifdef MFD_ALLOW_SEALING
+    // This environment variable is only for testing purposes.
+    if (qgetenv("SPECTACLE_KWIN_SCREENSHOT_TRANSPORT") == "pipe") {
+        return -1;
+    }
+    return memfd_create("spectacle-screenshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    return -1;
+#endif
+}
+
 template<typename... ArgType>
 ScreenShotSource2::ScreenShotSource2(const QString &methodName, ArgType... arguments)
 {
+    // KWin writes into a memfd that we can map directly instead of copying the image
+    // through a pipe. Fall back to a pipe when memfds aren't available.
     // Do not set the O_NONBLOCK flag. Code that reads data from the pipe assumes
     // that read() will block if there is no any data yet.
     int pipeFds[2]{-1, -1};
-    if (pipe2(pipeFds, O_CLOEXEC) == -1) {
+    const int memFd = createMemFd();
+    if (memFd != -1) {
+        m_transport = Transport::MemFd;
+        pipeFds[0] = memFd;
+        pipeFds[1] = memFd;
+    } else if (pipe2(pipeFds, O_CLOEXEC) == -1) {
         const auto errnum = errno;
         QTimer::singleShot(0, this, [this, errnum]{
             Q_EMIT finished({i18nc("@info, %1 is an error code", "pipe2() failed for KWin screenshot: %1", QString::fromLocal8Bit(strerror(errnum)))});
@@ -262,8 +444,10 @@ ScreenShotSource2::ScreenShotSource2(const QString &methodName, ArgType... argum
     // Spectacle might wait indefinitely for a reply that never comes.
     const int timeout = methodName != u"CaptureInteractive" ? 4000 : 60000;
     QDBusPendingCall pendingCall = QDBusConnection::sessionBus().asyncCall(message, timeout);
-    close(pipeFds[1]);
-    m_pipeFileDescriptor.giveFileDescriptor(pipeFds[0]);
+    if (m_transport == Transport::Pipe) {
+        close(pipeFds[1]);
+    }
+    m_fileDescriptor.giveFileDescriptor(pipeFds[0]);
 
     QTimer *timeoutTimer = nullptr;
     if (SPECTACLE_LOG().isDebugEnabled()) {
@@ -306,7 +490,17 @@ ScreenShotSource2::ScreenShotSource2(const QString &methodName, ArgType... argum
                 return;
             }
 
-            QFuture<ResultVariant> future = QtConcurrent::run(readImage, m_pipeFileDescriptor.takeFileDescriptor(), metadata);
+            Log::debug() << "KWin screenshot transport:" << (m_transport == Transport::MemFd ? "memfd" : "pipe");
+            const auto fileDescriptor = m_fileDescriptor.takeFileDescriptor();
+            // Look up the window info at the same time as the image is being read.
+            const auto info = lookUpWindowInfo(metadata.value(u"windowId"_s).toString());
+#ifdef MFD_ALLOW_SEALING
+            QFuture<ResultVariant> future = m_transport == Transport::MemFd //
+                ? QtConcurrent::run(mapImage, fileDescriptor, metadata, info)
+                : QtConcurrent::run(readImage, fileDescriptor, metadata, info);
+#else
+            QFuture<ResultVariant> future = QtConcurrent::run(readImage, fileDescriptor, metadata, info);
+#endif
             future.then([this](const ResultVariant &result) {
                 Q_EMIT finished(result);
             });
@@ -314,6 +508,11 @@ ScreenShotSource2::ScreenShotSource2(const QString &methodName, ArgType... argum
     });
 }
 
+ScreenShotSource2::Transport ScreenShotSource2::transport() const
+{
+    return m_transport;
+}
+
 ScreenShotSourceArea2::ScreenShotSourceArea2(const QRect &area, ImagePlatformKWin::ScreenShotFlags flags)
     : ScreenShotSource2(u"CaptureArea"_s,
                         qint32(area.x()),
@@ -352,19 +551,172 @@ ScreenShotSourceWorkspace2::ScreenShotSourceWorkspace2(ImagePlatformKWin::Screen
 {
 }
 
-ScreenShotSourceMeta2::ScreenShotSourceMeta2(const QVector<ScreenShotSource2 *> &sources)
+// Copies the rows [firstRow, lastRow) of an image that has the same format as the target.
+static void copyRows(const QImage &source, uchar *targetBits, qsizetype targetBytesPerLine, QPoint targetPos, int firstRow, int lastRow)
 {
-    const auto size = sources.size();
-    m_results.reserve(size); // reserves memory but does not change size
-    for (ScreenShotSource2 *source : sources) {
-        source->setParent(this);
-        connect(source, &ScreenShotSource2::finished, this, [this, size](const ResultVariant &result) {
-            m_results.emplaceBack(result);
-            if (m_results.size() == size) {
-                Q_EMIT finished(m_results);
+    const qsizetype bytesPerPixel = source.depth() / 8;
+    const qsizetype rowBytes = source.width() * bytesPerPixel;
+    uchar *target = targetBits + targetPos.y() * targetBytesPerLine + targetPos.x() * bytesPerPixel;
+    for (int y = firstRow; y < lastRow; ++y) {
+        std::memcpy(target + y * targetBytesPerLine, source.constScanLine(y), rowBytes);
+    }
+}
+
+static qreal expectedDevicePixelRatio(const QScreen *screen, ImagePlatformKWin::ScreenShotFlags flags)
+{
+    return flags.testFlag(ImagePlatformKWin::ScreenShotFlag::NativeSize) ? screen->devicePixelRatio() : 1.0;
+}
+
+ScreenShotSourceMeta2::ScreenShotSourceMeta2(const QList<QScreen *> &screens, ImagePlatformKWin::ScreenShotFlags flags)
+    : m_pendingSources(screens.size())
+{
+    // Plan the combined image from the screen geometries so that each screen can be copied into it
+    // as soon as its image arrives. The plan is checked against the real images at the end and
+    // combinedImage() is used instead if they don't match.
+    QList<QRectF> screenRects;
+    if (screens.size() > 1) {
+        qreal maxDpr = 0;
+        for (auto screen : screens) {
+            const auto dpr = expectedDevicePixelRatio(screen, flags);
+            const auto pos = Geometry::mapFromPlatformPoint(screen->geometry().topLeft(), dpr);
+            screenRects << QRectF{pos, screen->geometry().size()};
+            m_canvasRect |= screenRects.constLast();
+            m_allSameDpr &= maxDpr == 0 || maxDpr == dpr;
+            maxDpr = std::max(maxDpr, dpr);
+        }
+        // We ceil to the next integer size up so that integer DPR images are always crisp.
+        m_canvasDpr = m_allSameDpr ? maxDpr : std::ceil(maxDpr);
+        m_canvas = QImage{m_canvasRect.size().toSize() * m_canvasDpr, s_combinedImageFormat};
+        m_canvasValid = !m_canvas.isNull();
+    }
+    if (m_canvasValid) {
+        // Only the parts not covered by any screen need to be cleared.
+        QRegion uncovered{QRect{QPoint{}, m_canvas.size()}};
+        for (const auto &rect : std::as_const(screenRects)) {
+            uncovered -= QRectF{rect.topLeft() * m_canvasDpr, rect.size() * m_canvasDpr}.toAlignedRect();
+        }
+        if (!uncovered.isEmpty()) {
+            QPainter painter(&m_canvas);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            for (const auto &rect : uncovered) {
+                painter.fillRect(rect, Qt::transparent);
             }
+        }
+        // Workers write into the canvas through this pointer, so m_canvas must not be touched
+        // again until all of them are done.
+        m_canvasBits = m_canvas.bits();
+    }
+
+    for (auto screen : screens) {
+        auto source = new ScreenShotSourceScreen2(screen, flags);
+        source->setParent(this);
+        connect(source, &ScreenShotSource2::finished, this, &ScreenShotSourceMeta2::addResult);
+    }
+}
+
+ScreenShotSourceMeta2::~ScreenShotSourceMeta2()
+{
+    // The workers write into m_canvas.
+    for (auto &future : m_blits) {
+        future.waitForFinished();
+    }
+}
+
+void ScreenShotSourceMeta2::addResult(const ResultVariant &result)
+{
+    --m_pendingSources;
+    const auto index = result.index();
+    if (index == ResultVariant::Image) {
+        const auto &image = std::get<ResultVariant::Image>(result);
+        m_images << image;
+        blitImage(image);
+    } else if (index == ResultVariant::ErrorString) {
+        m_errorString.append(std::get<ResultVariant::ErrorString>(result) + u"\n"_s);
+    }
+    finishIfDone();
+}
+
+void ScreenShotSourceMeta2::blitImage(const QImage &image)
+{
+    if (!m_canvasValid) {
+        return;
+    }
+    const auto imageDpr = image.devicePixelRatio();
+    const auto targetPos = (ImageMetaData::logicalXY(image) * m_canvasDpr).toPoint();
+    const auto targetSize = m_allSameDpr ? image.size() : (image.deviceIndependentSize() * m_canvasDpr).toSize();
+    if ((m_allSameDpr && imageDpr != m_canvasDpr) || !QRect{QPoint{}, m_canvas.size()}.contains(QRect{targetPos, targetSize})) {
+        m_canvasValid = false;
+        return;
+    }
+
+    uchar *canvasBits = m_canvasBits;
+    const auto canvasBytesPerLine = m_canvas.bytesPerLine();
+    auto future = QtConcurrent::run([image, targetPos, targetSize, canvasBits, canvasBytesPerLine] {
+        QImage source = image;
+        if (targetSize != source.size()) {
+            const bool hasIntDpr = static_cast<int>(source.devicePixelRatio()) == source.devicePixelRatio();
+            const auto interpolation = hasIntDpr ? Qt::FastTransformation : Qt::SmoothTransformation;
+            source = source.scaled(targetSize, Qt::KeepAspectRatio, interpolation);
+        }
+        source.convertTo(s_combinedImageFormat);
+        // Split the rows between threads. The parts of the canvas never overlap.
+        const int height = source.height();
+        const int chunkCount = std::clamp(height / 64, 1, QThread::idealThreadCount());
+        QList<std::pair<int, int>> chunks;
+        chunks.reserve(chunkCount);
+        for (int i = 0; i < chunkCount; ++i) {
+            chunks.emplaceBack(height * i / chunkCount, height * (i + 1) / chunkCount);
+        }
+        QtConcurrent::blockingMap(chunks, [&](const std::pair<int, int> &chunk) {
+            copyRows(source, canvasBits, canvasBytesPerLine, targetPos, chunk.first, chunk.second);
+        });
+    });
+    m_blits << future;
+    ++m_pendingBlits;
+    future.then(this, [this] {
+        --m_pendingBlits;
+        finishIfDone();
+    });
+}
+
+void ScreenShotSourceMeta2::finishIfDone()
+{
+    if (m_pendingSources > 0 || m_pendingBlits > 0) {
+        return;
+    }
+
+    QImage finalImage;
+    if (m_canvasValid) {
+        // Make sure the canvas is what combinedImage() would have made from the same images.
+        QRectF imageRect;
+        qreal maxDpr = 0;
+        ImageMetaData::SubGeometryList geometryList;
+        for (const auto &image : std::as_const(m_images)) {
+            const auto dpr = image.devicePixelRatio();
+            const auto rect = QRectF{ImageMetaData::logicalXY(image), image.deviceIndependentSize()};
+            maxDpr = std::max(maxDpr, dpr);
+            imageRect |= rect;
+            geometryList << ImageMetaData::subGeometryPropertyMap(rect, dpr);
+        }
+        const bool allSameDpr = std::all_of(m_images.cbegin(), m_images.cend(), [maxDpr](const QImage &i) {
+            return i.devicePixelRatio() == maxDpr;
         });
+        const auto finalDpr = allSameDpr ? maxDpr : std::ceil(maxDpr);
+        if (m_errorString.isEmpty() && allSameDpr == m_allSameDpr && finalDpr == m_canvasDpr
+            && imageRect.size().toSize() * finalDpr == m_canvas.size()) {
+            m_blits.clear();
+            m_canvasBits = nullptr;
+            finalImage = std::move(m_canvas);
+            finalImage.setDevicePixelRatio(finalDpr);
+            ImageMetaData::setSubGeometryList(finalImage, geometryList);
+        }
+    }
+    if (finalImage.isNull()) {
+        finalImage = combinedImage(m_images);
     }
+    m_images.clear();
+
+    Q_EMIT finished(finalImage, m_errorString);
 }
 
 ImagePlatformKWin::ImagePlatformKWin(QObject *parent)
@@ -393,7 +745,7 @@ ImagePlatform::GrabModes ImagePlatformKWin::supportedGrabModes() const
 
 void ImagePlatformKWin::updateSupportedGrabModes()
 {
-    ImagePlatform::GrabModes grabModes = GrabMode::AllScreens | GrabMode::WindowUnderCursor | GrabMode::PerScreenImageNative;
+    ImagePlatform::GrabModes grabModes = GrabMode::AllScreens | GrabMode::WindowUnderCursor | GrabMode::PerScreenImageNative | GrabMode::Area;
 
     if (m_apiVersion >= 2) {
         grabModes |= GrabMode::ActiveWindow;
@@ -451,12 +803,26 @@ void ImagePlatformKWin::doGrab(ShutterMode, GrabMode grabMode, bool includePoint
     case GrabMode::PerScreenImageNative:
         takeScreenShotCroppable(flags);
         break;
+    case GrabMode::Area:
     case GrabMode::NoGrabModes:
         Q_EMIT newScreenshotFailed();
         break;
     }
 }
 
+void ImagePlatformKWin::doGrabArea(const QRect &area, bool includePointer)
+{
+    if (area.isEmpty()) {
+        Q_EMIT newScreenshotFailed();
+        return;
+    }
+    ScreenShotFlags flags = ScreenShotFlag::NativeSize;
+    if (includePointer) {
+        flags |= ScreenShotFlag::IncludeCursor;
+    }
+    takeScreenShotArea(area, flags);
+}
+
 void ImagePlatformKWin::trackSource(ScreenShotSource2 *source)
 {
     connect(source, &ScreenShotSource2::finished, this, [this, source](const ResultVariant &result) {
@@ -475,21 +841,10 @@ void ImagePlatformKWin::trackSource(ScreenShotSource2 *source)
 template<typename OutputSignal>
 void ImagePlatformKWin::trackSource(ScreenShotSourceMeta2 *source, OutputSignal outputSignal)
 {
-    connect(source, &ScreenShotSourceMeta2::finished, this, [this, source, outputSignal](const QList<ResultVariant> &results) {
+    connect(source, &ScreenShotSourceMeta2::finished, this, [this, source, outputSignal](const QImage &image, const QString &errorString) {
         source->deleteLater();
-        QList<QImage> images;
-        QString errorString;
-        for (const auto &result : results) {
-            const auto index = result.index();
-            if (index == ResultVariant::Image) {
-                images.push_back(std::get<ResultVariant::Image>(result));
-            } else if (index == ResultVariant::ErrorString) {
-                errorString.append(std::get<ResultVariant::ErrorString>(result) + u"\n"_s);
-            }
-        }
-
-        if (!images.empty()) {
-            Q_EMIT (this->*outputSignal)(combinedImage(images));
+        if (!image.isNull()) {
+            Q_EMIT (this->*outputSignal)(image);
         }
         if (!errorString.isEmpty()) {
             Q_EMIT newScreenshotFailed(errorString);
@@ -519,24 +874,12 @@ void ImagePlatformKWin::takeScreenShotActiveScreen(ScreenShotFlags flags)
 
 void ImagePlatformKWin::takeScreenShotWorkspace(ScreenShotFlags flags)
 {
-    const auto &screens = qGuiApp->screens();
-    QList<ScreenShotSource2 *> sources;
-    sources.reserve(screens.count());
-    for (auto screen : screens) {
-        sources.emplaceBack(new ScreenShotSourceScreen2(screen, flags));
-    }
-    trackSource(new ScreenShotSourceMeta2(sources), &ImagePlatform::newScreenshotTaken);
+    trackSource(new ScreenShotSourceMeta2(qGuiApp->screens(), flags), &ImagePlatform::newScreenshotTaken);
 }
 
 void ImagePlatformKWin::takeScreenShotCroppable(ScreenShotFlags flags)
 {
-    const auto &screens = qGuiApp->screens();
-    QList<ScreenShotSource2 *> sources;
-    sources.reserve(screens.count());
-    for (auto screen : screens) {
-        sources.emplaceBack(new ScreenShotSourceScreen2(screen, flags));
-    }
-    trackSource(new ScreenShotSourceMeta2(sources), &ImagePlatform::newCroppableScreenshotTaken);
+    trackSource(new ScreenShotSourceMeta2(qGuiApp->screens(), flags), &ImagePlatform::newCroppableScreenshotTaken);
 }
 
 #include "moc_ImagePlatformKWin.cpp"
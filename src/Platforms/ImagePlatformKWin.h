@@ -67,6 +67,7 @@ public:
 public Q_SLOTS:
     void
     doGrab(ImagePlatform::ShutterMode shutterMode, ImagePlatform::GrabMode grabMode, bool includePointer, bool includeDecorations, bool includeShadow) override;
+    void doGrabArea(const QRect &area, bool includePointer) override;
 
 private Q_SLOTS:
     void updateSupportedGrabModes();
@@ -100,11 +101,22 @@ public:
     template<typename... ArgType>
     explicit ScreenShotSource2(const QString &methodName, ArgType... arguments);
 
+    /**
+     * How the image data is transferred from KWin.
+     * A sealed memfd is mapped directly, a pipe is read into a newly allocated image.
+     */
+    enum class Transport {
+        Pipe,
+        MemFd,
+    };
+    Transport transport() const;
+
 Q_SIGNALS:
     void finished(const ResultVariant &result);
 
 private:
-    QDBusUnixFileDescriptor m_pipeFileDescriptor;
+    QDBusUnixFileDescriptor m_fileDescriptor;
+    Transport m_transport = Transport::Pipe;
 };
 
 /**
@@ -169,21 +181,38 @@ public:
 };
 
 /**
- * The ScreenShotSourceMeta2 class represents a screenshot source that is made of several
- * other sources.
+ * The ScreenShotSourceMeta2 class takes a screenshot of each of the given screens and combines
+ * them into one image. The combined image is allocated up front and each screen is copied into
+ * it on worker threads as soon as its image has been read, so the total time is close to the
+ * time of the slowest screen rather than the sum of all screens.
  */
 class ScreenShotSourceMeta2 final : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit ScreenShotSourceMeta2(const QList<ScreenShotSource2 *> &sources);
+    ScreenShotSourceMeta2(const QList<QScreen *> &screens, ImagePlatformKWin::ScreenShotFlags flags);
+    ~ScreenShotSourceMeta2() override;
 
 Q_SIGNALS:
-    void finished(const QList<ResultVariant> &results);
+    void finished(const QImage &image, const QString &errorString);
 
 private:
-    QList<ResultVariant> m_results;
+    void addResult(const ResultVariant &result);
+    void blitImage(const QImage &image);
+    void finishIfDone();
+
+    qsizetype m_pendingSources = 0;
+    int m_pendingBlits = 0;
+    QList<QImage> m_images;
+    QString m_errorString;
+    QList<QFuture<void>> m_blits;
+    QImage m_canvas;
+    uchar *m_canvasBits = nullptr;
+    QRectF m_canvasRect;
+    qreal m_canvasDpr = 1;
+    bool m_allSameDpr = true;
+    bool m_canvasValid = false;
 };
 
 /**
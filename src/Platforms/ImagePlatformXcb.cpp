@@ -5,9 +5,13 @@
  */
 
 #include "ImagePlatformXcb.h"
+#include "DebugUtils.h"
+#include "DropShadow.h"
 #include "ImageMetaData.h"
+#include "PlasmaVersion.h"
 
 #include <xcb/randr.h>
+#include <xcb/shm.h>
 #include <xcb/xcb_cursor.h>
 #include <xcb/xcb_util.h>
 #include <xcb/xfixes.h>
@@ -20,9 +24,7 @@
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
 #include <QDBusInterface>
-#include <QGraphicsDropShadowEffect>
-#include <QGraphicsPixmapItem>
-#include <QGraphicsScene>
+#include <QElapsedTimer>
 #include <QPainter>
 #include <QScreen>
 #include <QSet>
@@ -38,7 +40,12 @@
 
 using namespace Qt::StringLiterals;
 
+#include <atomic>
 #include <memory>
+#include <optional>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 /* -- XCB Image Smart Pointer ------------------------------------------------------------------ */
 
@@ -61,6 +68,95 @@ struct CFreeDeleter {
 template<typename Reply>
 using XcbReplyPtr = std::unique_ptr<Reply, CFreeDeleter>;
 
+/* -- MIT-SHM Segment -------------------------------------------------------------------------- */
+
+struct ImagePlatformXcb::ShmSegment {
+    xcb_shm_seg_t seg = XCB_NONE;
+    uchar *data = nullptr;
+    size_t size = 0;
+    // Set while a QImage is backed by this segment.
+    std::atomic_bool inUse = false;
+
+    ~ShmSegment()
+    {
+        // The connection is gone if the last image outlived the application.
+        auto xcbConn = qGuiApp ? QX11Info::connection() : nullptr;
+        if (seg != XCB_NONE && xcbConn) {
+            xcb_shm_detach(xcbConn, seg);
+            xcb_flush(xcbConn);
+        }
+        if (data) {
+            shmdt(data);
+        }
+    }
+
+    static std::shared_ptr<ShmSegment> create(size_t size)
+    {
+        auto xcbConn = QX11Info::connection();
+        const int id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+        if (id == -1) {
+            return {};
+        }
+        auto segment = std::make_shared<ShmSegment>();
+        auto address = shmat(id, nullptr, 0);
+        if (address != reinterpret_cast<void *>(-1)) {
+            segment->data = static_cast<uchar *>(address);
+            segment->size = size;
+            segment->seg = xcb_generate_id(xcbConn);
+            auto cookie = xcb_shm_attach_checked(xcbConn, segment->seg, id, false);
+            XcbReplyPtr<xcb_generic_error_t> error(xcb_request_check(xcbConn, cookie));
+            if (error) {
+                segment->seg = XCB_NONE;
+            }
+        }
+        // The segment is destroyed once both we and the X server have detached from it.
+        shmctl(id, IPC_RMID, nullptr);
+        if (segment->seg == XCB_NONE) {
+            return {};
+        }
+        return segment;
+    }
+};
+
+static QImage::Format imageFormatForDepth(uint8_t depth)
+{
+    switch (depth) {
+    case 1:
+        return QImage::Format_MonoLSB;
+    case 16:
+        return QImage::Format_RGB16;
+    case 24:
+        return QImage::Format_RGB32;
+    case 30:
+        return QImage::Format_RGB30;
+    case 32:
+        return QImage::Format_ARGB32_Premultiplied;
+    default:
+        return QImage::Format_Invalid; // we don't know
+    }
+}
+
+// the RGB32 format requires data format 0xffRRGGBB, ensure that this fourth byte really is 0xff
+static void fixRgb32Alpha(uchar *bits, int width, int height, qsizetype bytesPerLine)
+{
+    for (int y = 0; y < height; ++y) {
+        auto line = reinterpret_cast<quint32 *>(bits + y * bytesPerLine);
+        for (int x = 0; x < width; ++x) {
+            line[x] |= 0xff000000;
+        }
+    }
+}
+
+// work around an abort in QImage::color
+static void setMonoColorTable(QImage &image)
+{
+    if (image.format() == QImage::Format_MonoLSB) {
+        image.setColorCount(2);
+        image.setColor(0, QColor(Qt::white).rgb());
+        image.setColor(1, QColor(Qt::black).rgb());
+    }
+}
+
 /* -- On Click Native Event Filter ------------------------------------------------------------- */
 
 class ImagePlatformXcb::OnClickEventFilter : public QAbstractNativeEventFilter
@@ -128,6 +224,40 @@ private:
     bool m_includeShadow{true};
 };
 
+/* -- Cursor Change Native Event Filter -------------------------------------------------------- */
+
+class ImagePlatformXcb::CursorEventFilter : public QAbstractNativeEventFilter
+{
+public:
+    CursorEventFilter(ImagePlatformXcb *platformPtr, uint8_t xfixesFirstEvent)
+        : m_platformPtr(platformPtr)
+        , m_cursorNotifyEvent(xfixesFirstEvent + XCB_XFIXES_CURSOR_NOTIFY)
+    {
+    }
+
+    bool nativeEventFilter(const QByteArray &eventType, void *message, qintptr * /*result*/) override
+    {
+        if (eventType == "xcb_generic_event_t") {
+            auto event = static_cast<xcb_generic_event_t *>(message);
+            if ((event->response_type & ~0x80) == m_cursorNotifyEvent) {
+                auto cursorEvent = static_cast<xcb_xfixes_cursor_notify_event_t *>(message);
+                // Compare with the last notification rather than the last reply,
+                // so that changing back to an earlier cursor still sends a new request.
+                if (cursorEvent->cursor_serial != m_platformPtr->m_notifiedCursorSerial) {
+                    m_platformPtr->m_notifiedCursorSerial = cursorEvent->cursor_serial;
+                    m_platformPtr->requestCursorImage();
+                }
+            }
+        }
+        // Qt doesn't use cursor notifications itself.
+        return false;
+    }
+
+private:
+    ImagePlatformXcb *m_platformPtr;
+    const uint8_t m_cursorNotifyEvent;
+};
+
 /* -- General Plumbing ------------------------------------------------------------------------- */
 
 ImagePlatformXcb::ImagePlatformXcb(QObject *parent)
@@ -135,12 +265,54 @@ ImagePlatformXcb::ImagePlatformXcb(QObject *parent)
     , m_nativeEventFilter(new OnClickEventFilter(this))
 {
     updateSupportedGrabModes();
+
+    // This environment variable is only for testing purposes.
+    // It allows comparing both capture paths, e.g. under Xvfb.
+    if (qgetenv("SPECTACLE_XCB_SHM") != "0") {
+        auto xcbConn = QX11Info::connection();
+        auto extension = xcb_get_extension_data(xcbConn, &xcb_shm_id);
+        if (extension && extension->present) {
+            auto cookie = xcb_shm_query_version_unchecked(xcbConn);
+            XcbReplyPtr<xcb_shm_query_version_reply_t> reply(xcb_shm_query_version_reply(xcbConn, cookie, nullptr));
+            m_shmAvailable = reply != nullptr;
+        }
+    }
+    Log::debug() << "MIT-SHM screen capture" << (m_shmAvailable ? "available" : "unavailable");
+
+    // Toplevels only get a different client window when windows are added or removed.
+    connect(KX11Extras::self(), &KX11Extras::windowAdded, this, [this] {
+        m_clientWindowCache.clear();
+    });
+    connect(KX11Extras::self(), &KX11Extras::windowRemoved, this, [this] {
+        m_clientWindowCache.clear();
+    });
+
+    // Keep the cursor image cached while XFixes tells us about cursor changes.
+    {
+        auto xcbConn = QX11Info::connection();
+        auto extension = xcb_get_extension_data(xcbConn, &xcb_xfixes_id);
+        if (extension && extension->present) {
+            auto cookie = xcb_xfixes_select_cursor_input_checked(xcbConn, QX11Info::appRootWindow(), XCB_XFIXES_CURSOR_NOTIFY_MASK_DISPLAY_CURSOR);
+            XcbReplyPtr<xcb_generic_error_t> error(xcb_request_check(xcbConn, cookie));
+            if (!error) {
+                m_cursorEventFilter = std::make_unique<CursorEventFilter>(this, extension->first_event);
+                qApp->installNativeEventFilter(m_cursorEventFilter.get());
+            }
+        }
+    }
+
     connect(qGuiApp, &QGuiApplication::screenAdded, this, &ImagePlatformXcb::updateSupportedGrabModes);
     connect(qGuiApp, &QGuiApplication::screenRemoved, this, &ImagePlatformXcb::updateSupportedGrabModes);
 }
 
 ImagePlatformXcb::~ImagePlatformXcb()
 {
+    if (m_cursorEventFilter) {
+        qApp->removeNativeEventFilter(m_cursorEventFilter.get());
+    }
+    if (m_cursorImageCookie) {
+        xcb_discard_reply(QX11Info::connection(), m_cursorImageCookie->sequence);
+    }
 }
 
 ImagePlatform::GrabModes ImagePlatformXcb::supportedGrabModes() const
@@ -153,7 +325,7 @@ void ImagePlatformXcb::updateSupportedGrabModes()
     ImagePlatform::GrabModes grabModes = {
         GrabMode::AllScreens, GrabMode::ActiveWindow,
         GrabMode::WindowUnderCursor, GrabMode::TransientWithParent,
-        GrabMode::PerScreenImageNative
+        GrabMode::PerScreenImageNative, GrabMode::Area
     };
 
     if (QApplication::screens().count() > 1) {
@@ -171,6 +343,23 @@ ImagePlatform::ShutterModes ImagePlatformXcb::supportedShutterModes() const
     return {ShutterMode::Immediate | ShutterMode::OnClick};
 }
 
+int ImagePlatformXcb::minimumCaptureDelay() const
+{
+    if (PlasmaVersion::get() < PlasmaVersion::check(5, 27, 4) && KX11Extras::compositingActive()) {
+        // when compositing is enabled, we need to give it enough time for the window
+        // to disappear and all the effects are complete before we take the shot. there's
+        // no way of knowing how long the disappearing effects take, but as per default
+        // settings (and unless the user has set an extremely slow effect), 200
+        // milliseconds is a good amount of wait time.
+        return 200;
+    }
+    // X11 compositors (which may or may not be kwin) require small delay for
+    // window to disappear.
+    // Also, minimum 50ms delay is needed to prevent segfaults from xcb function
+    // calls that don't get replies fast enough.
+    return 50;
+}
+
 void ImagePlatformXcb::doGrab(ShutterMode shutterMode, GrabMode grabMode, bool includePointer, bool includeDecorations, bool includeShadow)
 {
     switch (shutterMode) {
@@ -185,6 +374,24 @@ void ImagePlatformXcb::doGrab(ShutterMode shutterMode, GrabMode grabMode, bool i
     }
 }
 
+void ImagePlatformXcb::doGrabArea(const QRect &area, bool includePointer)
+{
+    if (area.isEmpty()) {
+        Q_EMIT newScreenshotFailed();
+        return;
+    }
+    // The area is in logical coordinates, but X11 uses device pixels.
+    const qreal dpr = qGuiApp->devicePixelRatio();
+    const QRect nativeRect = QRectF(QPointF(area.topLeft()) * dpr, QSizeF(area.size()) * dpr).toAlignedRect();
+    auto image = getToplevelImage(nativeRect, includePointer);
+    if (image.isNull()) {
+        Q_EMIT newScreenshotFailed();
+        return;
+    }
+    image.setDevicePixelRatio(dpr);
+    Q_EMIT newScreenshotTaken(image);
+}
+
 /* -- XCB Utilities ---------------------------------------------------------------------------- */
 
 QPoint ImagePlatformXcb::getCursorPosition()
@@ -226,53 +433,110 @@ xcb_window_t ImagePlatformXcb::getWindowUnderCursor()
         return QX11Info::appRootWindow();
     }
 
-    // now start testing
-    QStack<xcb_window_t> windowStack;
-    windowStack.push(pointerReply->child);
-
-    while (!windowStack.isEmpty()) {
-        appWin = windowStack.pop();
-
-        // next, check if our window has the WM_STATE property set on
-        // the window. if yes, return the window - we have found it
-        auto propCookie = xcb_get_property_unchecked(xcbConn, 0, appWin, atomReply->atom, XCB_ATOM_ANY, 0, 0);
-        XcbReplyPtr<xcb_get_property_reply_t> propReply(xcb_get_property_reply(xcbConn, propCookie, nullptr));
+    const auto wmStateAtom = atomReply->atom;
+    const auto topLevel = pointerReply->child;
+    auto hasWmState = [xcbConn, wmStateAtom](xcb_get_property_cookie_t cookie) {
+        XcbReplyPtr<xcb_get_property_reply_t> propReply(xcb_get_property_reply(xcbConn, cookie, nullptr));
+        return propReply && propReply->type != XCB_ATOM_NONE;
+    };
 
-        if (propReply && propReply->type != XCB_ATOM_NONE) {
-            return appWin;
+    // The client window of a toplevel only changes when windows are added or removed.
+    // Still make sure the cached window is managed before trusting it.
+    if (auto it = m_clientWindowCache.constFind(topLevel); it != m_clientWindowCache.cend()) {
+        auto cookie = xcb_get_property_unchecked(xcbConn, 0, it.value(), wmStateAtom, XCB_ATOM_ANY, 0, 0);
+        if (hasWmState(cookie)) {
+            return it.value();
         }
+        m_clientWindowCache.remove(topLevel);
+    }
 
-        // if we're here, this means the window is not the real window
-        // we should start looking at its children
-        auto treeCookie = xcb_query_tree_unchecked(xcbConn, appWin);
-        XcbReplyPtr<xcb_query_tree_reply_t> treeReply(xcb_query_tree_reply(xcbConn, treeCookie, nullptr));
-        if (!treeReply) {
-            continue;
+    // Find the first window with the WM_STATE property set in depth-first pre-order.
+    // The tree is walked one level at a time so that the requests for a whole level
+    // can be sent before waiting for any of the replies. Each window's path of child
+    // indices orders it in pre-order, so subtrees that come after an already found
+    // window don't need to be searched.
+    struct Node {
+        xcb_window_t window;
+        QList<int> path;
+    };
+    QList<Node> level = {{topLevel, {}}};
+    std::optional<Node> found;
+    while (!level.isEmpty()) {
+        QList<xcb_get_property_cookie_t> propCookies;
+        QList<xcb_query_tree_cookie_t> treeCookies;
+        propCookies.reserve(level.size());
+        treeCookies.reserve(level.size());
+        for (const auto &node : std::as_const(level)) {
+            propCookies << xcb_get_property_unchecked(xcbConn, 0, node.window, wmStateAtom, XCB_ATOM_ANY, 0, 0);
+            treeCookies << xcb_query_tree_unchecked(xcbConn, node.window);
         }
-        auto windowChildren = xcb_query_tree_children(treeReply.get());
-        auto windowChildrenLength = xcb_query_tree_children_length(treeReply.get());
 
-        for (int iIdx = windowChildrenLength - 1; iIdx >= 0; iIdx--) {
-            windowStack.push(windowChildren[iIdx]);
+        QList<Node> nextLevel;
+        for (qsizetype i = 0; i < level.size(); ++i) {
+            const auto &node = level[i];
+            if (found && found->path < node.path) {
+                xcb_discard_reply(xcbConn, propCookies[i].sequence);
+                xcb_discard_reply(xcbConn, treeCookies[i].sequence);
+                continue;
+            }
+            if (hasWmState(propCookies[i])) {
+                xcb_discard_reply(xcbConn, treeCookies[i].sequence);
+                found = node;
+                continue;
+            }
+            XcbReplyPtr<xcb_query_tree_reply_t> treeReply(xcb_query_tree_reply(xcbConn, treeCookies[i], nullptr));
+            if (!treeReply) {
+                continue;
+            }
+            auto windowChildren = xcb_query_tree_children(treeReply.get());
+            auto windowChildrenLength = xcb_query_tree_children_length(treeReply.get());
+            for (int iIdx = 0; iIdx < windowChildrenLength; iIdx++) {
+                nextLevel.append({windowChildren[iIdx], node.path + QList<int>{iIdx}});
+            }
         }
+        level = std::move(nextLevel);
+    }
+
+    if (found) {
+        m_clientWindowCache.insert(topLevel, found->window);
+        return found->window;
     }
 
     // return the window. it has geometry information for a crop
-    return pointerReply->child;
+    return topLevel;
 }
 
-xcb_window_t ImagePlatformXcb::getTransientWindowParent(xcb_window_t childWindow, QRect &windowRectOut, bool includeDecorations)
+QHash<xcb_window_t, xcb_window_t> ImagePlatformXcb::getTransientWindowParents(const QList<xcb_window_t> &windows)
 {
-    NET::Properties netProp = includeDecorations ? NET::WMFrameExtents : NET::WMGeometry;
-    KWindowInfo windowInfo(childWindow, netProp, NET::WM2TransientFor);
+    auto xcbConn = QX11Info::connection();
+
+    // Send all requests before waiting for the first reply.
+    QList<xcb_get_property_cookie_t> cookies;
+    cookies.reserve(windows.size());
+    for (auto window : windows) {
+        cookies << xcb_get_property_unchecked(xcbConn, 0, window, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+    }
+
+    QHash<xcb_window_t, xcb_window_t> parents;
+    parents.reserve(windows.size());
+    for (qsizetype i = 0; i < windows.size(); ++i) {
+        XcbReplyPtr<xcb_get_property_reply_t> propReply(xcb_get_property_reply(xcbConn, cookies[i], nullptr));
+        xcb_window_t parent = XCB_WINDOW_NONE;
+        if (propReply && propReply->type == XCB_ATOM_WINDOW && propReply->format == 32
+            && xcb_get_property_value_length(propReply.get()) >= int(sizeof(xcb_window_t))) {
+            parent = *static_cast<xcb_window_t *>(xcb_get_property_value(propReply.get()));
+        }
+        parents.insert(windows[i], parent);
+    }
+    return parents;
+}
 
-    // add the current window to the image
+QRect ImagePlatformXcb::getWindowRect(xcb_window_t window, bool includeDecorations)
+{
     if (includeDecorations) {
-        windowRectOut = windowInfo.frameGeometry();
-    } else {
-        windowRectOut = windowInfo.geometry();
+        return KWindowInfo(window, NET::WMFrameExtents).frameGeometry();
     }
-    return windowInfo.transientFor();
+    return KWindowInfo(window, NET::WMGeometry).geometry();
 }
 
 QList<QRect> ImagePlatformXcb::getScreenRects()
@@ -295,115 +559,153 @@ QList<QRect> ImagePlatformXcb::getScreenRects()
 
 QImage ImagePlatformXcb::addDropShadow(QImage &image)
 {
-    // Create a new image that is 20px wider and 20px taller than the original image
-    QImage shadowImage(image.size() + QSize(40, 40), QImage::Format_ARGB32);
-    shadowImage.fill(Qt::transparent);
-
-    // Create a painter for the shadow image
-    QPainter shadowPainter(&shadowImage);
-
-    // Create a pixmap item for the original image
-    auto pixmapItem = new QGraphicsPixmapItem;
-    pixmapItem->setPixmap(QPixmap::fromImage(image));
-
-    // Create a drop shadow effect for the pixmap item
-    auto shadowEffect = new QGraphicsDropShadowEffect;
-    shadowEffect->setOffset(0);
-    shadowEffect->setBlurRadius(20);
-    pixmapItem->setGraphicsEffect(shadowEffect);
-
-    // Create a graphics scene and add the pixmap item to it
-    QGraphicsScene graphicsScene;
-    graphicsScene.addItem(pixmapItem);
-
-    // Render the graphics scene to the shadow image
-    graphicsScene.render(&shadowPainter, QRectF(), QRectF(-20, -20, image.width() + 40, image.height() + 40));
-    shadowPainter.end();
-
-    // Return the shadow image
-    return shadowImage;
+    static const DropShadow dropShadow;
+    return dropShadow.apply(image);
 }
 
 QImage ImagePlatformXcb::convertFromNative(xcb_image_t *xcbImage)
 {
-    auto imageFormat = QImage::Format_Invalid;
-    switch (xcbImage->depth) {
-    case 1:
-        imageFormat = QImage::Format_MonoLSB;
-        break;
-    case 16:
-        imageFormat = QImage::Format_RGB16;
-        break;
-    case 24:
-        imageFormat = QImage::Format_RGB32;
-        break;
-    case 30:
-        imageFormat = QImage::Format_RGB30;
-        break;
-    case 32:
-        imageFormat = QImage::Format_ARGB32_Premultiplied;
-        break;
-    default:
-        return {}; // we don't know
+    const auto imageFormat = imageFormatForDepth(xcbImage->depth);
+    if (imageFormat == QImage::Format_Invalid) {
+        return {};
     }
 
-    // the RGB32 format requires data format 0xffRRGGBB, ensure that this fourth byte really is 0xff
     if (imageFormat == QImage::Format_RGB32) {
-        auto data = reinterpret_cast<quint32 *>(xcbImage->data);
-        for (size_t iIter = 0; iIter < xcbImage->width * xcbImage->height; iIter++) {
-            data[iIter] |= 0xff000000;
-        }
+        fixRgb32Alpha(xcbImage->data, xcbImage->width, xcbImage->height, xcbImage->stride);
     }
 
-    QImage image(xcbImage->data, xcbImage->width, xcbImage->height, imageFormat);
+    QImage image(xcbImage->data, xcbImage->width, xcbImage->height, xcbImage->stride, imageFormat);
     if (image.isNull()) {
         return {};
     }
-
-    // work around an abort in QImage::color
-    if (image.format() == QImage::Format_MonoLSB) {
-        image.setColorCount(2);
-        image.setColor(0, QColor(Qt::white).rgb());
-        image.setColor(1, QColor(Qt::black).rgb());
-    }
+    setMonoColorTable(image);
 
     // the image is ready. Since the backing data from xcbImage could be freed
     // before the image goes away, a deep copy is necessary.
     return image.copy();
 }
 
-QImage ImagePlatformXcb::blendCursorImage(QImage &image, const QRect rect)
+QImage ImagePlatformXcb::getShmImageFromDrawable(xcb_drawable_t xcbDrawable, const QRect &rect)
 {
-    // If the cursor position lies outside the area, do not bother drawing a cursor.
+    if (!m_shmAvailable || rect.isEmpty()) {
+        return {};
+    }
 
-    auto cursorPos = getCursorPosition();
-    if (!rect.contains(cursorPos)) {
-        return image;
+    // No supported depth uses more than 32 bits per pixel.
+    const size_t requiredSize = size_t(rect.width()) * size_t(rect.height()) * 4;
+    if (!m_shmSegment || m_shmSegment->inUse || m_shmSegment->size < requiredSize) {
+        // Size new segments for the largest screen so that later captures can reuse them.
+        size_t size = requiredSize;
+        const auto screenRects = getScreenRects();
+        for (const auto &screenRect : screenRects) {
+            size = std::max(size, size_t(screenRect.width()) * size_t(screenRect.height()) * 4);
+        }
+        // The previous segment stays alive until the last image using it is gone.
+        m_shmSegment = ShmSegment::create(size);
+        if (!m_shmSegment) {
+            // Most likely a remote X server. Don't try again.
+            Log::debug() << "Could not attach a MIT-SHM segment, falling back to xcb_image_get";
+            m_shmAvailable = false;
+            return {};
+        }
+    }
+
+    auto xcbConn = QX11Info::connection();
+    auto cookie = xcb_shm_get_image_unchecked(xcbConn, xcbDrawable, rect.x(), rect.y(), rect.width(), rect.height(), ~0,
+                                              XCB_IMAGE_FORMAT_Z_PIXMAP, m_shmSegment->seg, 0);
+    XcbReplyPtr<xcb_shm_get_image_reply_t> reply(xcb_shm_get_image_reply(xcbConn, cookie, nullptr));
+    if (!reply) {
+        return {};
+    }
+    const auto imageFormat = imageFormatForDepth(reply->depth);
+    const qsizetype bytesPerLine = reply->size / rect.height();
+    if (imageFormat == QImage::Format_Invalid || reply->size > m_shmSegment->size) {
+        return {};
+    }
+
+    if (imageFormat == QImage::Format_RGB32) {
+        fixRgb32Alpha(m_shmSegment->data, rect.width(), rect.height(), bytesPerLine);
+    }
+
+    // Wrap the segment without copying. It can be reused once the image data is released.
+    m_shmSegment->inUse = true;
+    auto cleanupInfo = new std::shared_ptr<ShmSegment>(m_shmSegment);
+    auto cleanup = [](void *info) {
+        auto segment = static_cast<std::shared_ptr<ShmSegment> *>(info);
+        (*segment)->inUse = false;
+        delete segment;
+    };
+    QImage image(m_shmSegment->data, rect.width(), rect.height(), bytesPerLine, imageFormat, cleanup, cleanupInfo);
+    if (image.isNull()) {
+        // QImage doesn't call the cleanup function for an invalid image.
+        cleanup(cleanupInfo);
+        return {};
     }
+    setMonoColorTable(image);
+    return image;
+}
 
-    // now we can get the image and start processing
+void ImagePlatformXcb::requestCursorImage()
+{
+    // Only send the request here. The reply is read when the cursor is needed,
+    // by which time it has usually arrived already.
     auto xcbConn = QX11Info::connection();
+    if (m_cursorImageCookie) {
+        xcb_discard_reply(xcbConn, m_cursorImageCookie->sequence);
+    }
+    m_cursorImageCookie = xcb_xfixes_get_cursor_image_unchecked(xcbConn);
+    xcb_flush(xcbConn);
+}
+
+void ImagePlatformXcb::updateCursorImage()
+{
+    // Without cursor notifications, the cache can't be trusted.
+    if (!m_cursorImageCookie && (!m_cursorEventFilter || m_cursorImage.isNull())) {
+        requestCursorImage();
+    }
+    if (!m_cursorImageCookie) {
+        return;
+    }
 
-    auto cursorCookie = xcb_xfixes_get_cursor_image_unchecked(xcbConn);
-    XcbReplyPtr<xcb_xfixes_get_cursor_image_reply_t> cursorReply(xcb_xfixes_get_cursor_image_reply(xcbConn, cursorCookie, nullptr));
+    auto xcbConn = QX11Info::connection();
+    XcbReplyPtr<xcb_xfixes_get_cursor_image_reply_t> cursorReply(xcb_xfixes_get_cursor_image_reply(xcbConn, *m_cursorImageCookie, nullptr));
+    m_cursorImageCookie.reset();
+    m_cursorImage = {};
     if (!cursorReply) {
-        return image;
+        return;
     }
 
     // get the image and process it into a qimage
     auto pixelData = xcb_xfixes_get_cursor_image_cursor_image(cursorReply.get());
     if (!pixelData) {
+        return;
+    }
+    // XFixes cursor images are premultiplied. The reply is freed, so copy the pixels.
+    m_cursorImage = QImage(reinterpret_cast<const uchar *>(pixelData), cursorReply->width, cursorReply->height, QImage::Format_ARGB32_Premultiplied).copy();
+    m_cursorHotspot = QPoint(cursorReply->xhot, cursorReply->yhot);
+}
+
+QImage ImagePlatformXcb::blendCursorImage(QImage &image, const QRect rect)
+{
+    // If the cursor position lies outside the area, do not bother drawing a cursor.
+
+    auto cursorPos = getCursorPosition();
+    if (!rect.contains(cursorPos)) {
+        return image;
+    }
+
+    updateCursorImage();
+    if (m_cursorImage.isNull()) {
         return image;
     }
-    QImage cursorImage(reinterpret_cast<quint8 *>(pixelData), cursorReply->width, cursorReply->height, QImage::Format_ARGB32_Premultiplied);
 
     // a small fix for the cursor position for fancier cursors
-    cursorPos -= QPoint(cursorReply->xhot, cursorReply->yhot);
+    cursorPos -= m_cursorHotspot;
 
     // now we translate the cursor point to our screen rectangle and do the painting
     cursorPos -= QPoint(rect.x(), rect.y());
     QPainter painter(&image);
-    painter.drawImage(cursorPos, cursorImage);
+    painter.drawImage(cursorPos, m_cursorImage);
     return image;
 }
 
@@ -420,6 +722,13 @@ QImage ImagePlatformXcb::postProcessImage(QImage &image, QRect rect, bool blendP
 
 QImage ImagePlatformXcb::getImageFromDrawable(xcb_drawable_t xcbDrawable, const QRect &rect)
 {
+    QElapsedTimer timer;
+    timer.start();
+    if (auto image = getShmImageFromDrawable(xcbDrawable, rect); !image.isNull()) {
+        Log::debug() << "Captured" << rect << "with MIT-SHM in" << timer.nsecsElapsed() / 1000 << "µs";
+        return image;
+    }
+
     auto xcbConn = QX11Info::connection();
 
     // proceed to get an image based on the geometry (in device pixels)
@@ -431,7 +740,9 @@ QImage ImagePlatformXcb::getImageFromDrawable(xcb_drawable_t xcbDrawable, const
     }
 
     // now process the image
-    return convertFromNative(xcbImage.get());
+    auto image = convertFromNative(xcbImage.get());
+    Log::debug() << "Captured" << rect << "with xcb_image_get in" << timer.nsecsElapsed() / 1000 << "µs";
+    return image;
 }
 
 QImage ImagePlatformXcb::getToplevelImage(QRect rect, bool blendPointer)
@@ -579,6 +890,14 @@ void ImagePlatformXcb::grabTransientWithParent(bool includePointer, bool include
     auto image = getToplevelImage(QRect(), false);
     image.setDevicePixelRatio(qGuiApp->devicePixelRatio());
 
+    // Look up the parents of all windows at once instead of one round trip per window.
+    const auto winList = KX11Extras::stackingOrder();
+    QList<xcb_window_t> windows(winList.cbegin(), winList.cend());
+    if (!winList.contains(window)) {
+        windows << window;
+    }
+    auto transientParents = getTransientWindowParents(windows);
+
     // now that we know we have a transient window, let's
     // find other possible transient windows and the app window itself.
     QRegion clipRegion;
@@ -588,13 +907,16 @@ void ImagePlatformXcb::grabTransientWithParent(bool includePointer, bool include
     do {
         // find parent window and add the window to the visible region
         auto winId = parentWindow;
-        QRect winRect;
-        parentWindow = getTransientWindowParent(winId, winRect, includeDecorations);
+        if (!transientParents.contains(winId)) {
+            transientParents.insert(getTransientWindowParents({winId}));
+        }
+        parentWindow = transientParents.value(winId);
         transientWindows << winId;
 
         // Don't include the 1x1 pixel sized desktop window in the top left corner that is present
         // if the window is a QDialog without a parent.
         // BUG: 376350
+        const auto winRect = getWindowRect(winId, includeDecorations);
         if (winRect != desktopRect) {
             clipRegion += winRect;
         }
@@ -605,16 +927,12 @@ void ImagePlatformXcb::grabTransientWithParent(bool includePointer, bool include
     // All parents are known now, find other transient children.
     // Assume that the lowest window is behind everything else, then if a new
     // transient window is discovered, its children can then also be found.
-    const auto winList = KX11Extras::stackingOrder();
     for (auto winId : winList) {
-        QRect winRect;
-        auto parentWindow = getTransientWindowParent(winId, winRect, includeDecorations);
-
         // if the parent should be displayed, then show the child too
-        if (transientWindows.contains(parentWindow)) {
+        if (transientWindows.contains(transientParents.value(winId))) {
             if (!transientWindows.contains(winId)) {
                 transientWindows << winId;
-                clipRegion += winRect;
+                clipRegion += getWindowRect(winId, includeDecorations);
             }
         }
     }
@@ -665,6 +983,7 @@ void ImagePlatformXcb::doGrabNow(GrabMode grabMode, bool includePointer, bool in
     case GrabMode::TransientWithParent:
         grabTransientWithParent(includePointer, includeDecorations, includeShadow);
         break;
+    case GrabMode::Area:
     case GrabMode::NoGrabModes:
         Q_EMIT newScreenshotFailed();
     }
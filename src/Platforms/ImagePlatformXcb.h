@@ -10,9 +10,13 @@
 
 #include <xcb/xcb.h>
 #include <xcb/xcb_image.h>
+#include <xcb/xfixes.h>
 
+#include <QHash>
 #include <QPixmap>
 
+#include <optional>
+
 class ImagePlatformXcb final : public ImagePlatform
 {
     Q_OBJECT
@@ -23,6 +27,7 @@ public:
 
     GrabModes supportedGrabModes() const override final;
     ShutterModes supportedShutterModes() const override final;
+    int minimumCaptureDelay() const override final;
 
 public Q_SLOTS:
     void doGrab(ImagePlatform::ShutterMode shutterMode,
@@ -30,6 +35,7 @@ public Q_SLOTS:
                 bool includePointer,
                 bool includeDecorations,
                 bool includeShadow) override final;
+    void doGrabArea(const QRect &area, bool includePointer) override final;
 
 private Q_SLOTS:
     void updateSupportedGrabModes();
@@ -40,7 +46,8 @@ private:
     QPoint getCursorPosition();
     QRect getDrawableGeometry(xcb_drawable_t drawable);
     xcb_window_t getWindowUnderCursor();
-    xcb_window_t getTransientWindowParent(xcb_window_t childWindow, QRect &windowRectOut, bool includeDecorations);
+    QHash<xcb_window_t, xcb_window_t> getTransientWindowParents(const QList<xcb_window_t> &windows);
+    QRect getWindowRect(xcb_window_t window, bool includeDecorations);
 
     /* ----------------------- Image Processing Utilities ----------------------- */
 
@@ -53,6 +60,9 @@ private:
 
     QList<QRect> getScreenRects();
     QImage convertFromNative(xcb_image_t *xcbImage);
+    QImage getShmImageFromDrawable(xcb_drawable_t xcbDrawable, const QRect &rect);
+    void requestCursorImage();
+    void updateCursorImage();
     QImage blendCursorImage(QImage &image, const QRect rect);
     QImage postProcessImage(QImage &image, QRect rect, bool blendPointer);
     QImage getImageFromDrawable(xcb_drawable_t xcbDrawable, const QRect &rect);
@@ -70,5 +80,21 @@ private:
     class OnClickEventFilter;
     std::unique_ptr<OnClickEventFilter> m_nativeEventFilter;
 
+    // the cursor image is requested again whenever XFixes reports a different cursor serial
+    class CursorEventFilter;
+    std::unique_ptr<CursorEventFilter> m_cursorEventFilter;
+    std::optional<xcb_xfixes_get_cursor_image_cookie_t> m_cursorImageCookie;
+    QImage m_cursorImage;
+    QPoint m_cursorHotspot;
+    uint32_t m_notifiedCursorSerial = 0;
+
     GrabModes m_grabModes;
+
+    // client windows found by getWindowUnderCursor(), keyed by their toplevel window
+    QHash<xcb_window_t, xcb_window_t> m_clientWindowCache;
+
+    // MIT-SHM segment reused across captures while no image is backed by it
+    struct ShmSegment;
+    std::shared_ptr<ShmSegment> m_shmSegment;
+    bool m_shmAvailable = false;
 };
@@ -19,13 +19,9 @@
 #include "Gui/InlineMessageModel.h"
 #include "ImageMetaData.h"
 #include "OcrManager.h"
-#if WITH_X11
-#include "Platforms/ImagePlatformXcb.h"
-#endif
 #include "Platforms/PlatformLoader.h"
 #include "RecordingModeModel.h"
 #include "ShortcutActions.h"
-#include "PlasmaVersion.h"
 // generated
 #include "settings.h"
 
@@ -37,9 +33,6 @@
 #include <KNotification>
 #include <KStatusNotifierItem>
 #include <KWindowSystem>
-#if WITH_X11
-#include <KX11Extras>
-#endif
 #include <LayerShellQt/Shell>
 #include <LayerShellQt/Window>
 
@@ -79,7 +72,7 @@ static QList<KNotification *> notifications;
 SpectacleCore::SpectacleCore(QObject *parent)
     : QObject(parent)
 {
-    // Timer to prevent lots of extra rendering to images
+    // Timer to wait for annotation edits to settle before encoding in the background
     m_annotationSyncTimer = std::make_unique<QTimer>();
     m_annotationSyncTimer->setInterval(400);
     m_annotationSyncTimer->setSingleShot(true);
@@ -119,7 +112,7 @@ SpectacleCore::SpectacleCore(QObject *parent)
         }
     };
     auto onFinished = [this]() {
-        m_imagePlatform->doGrab(ImagePlatform::ShutterMode::Immediate, m_lastGrabMode, m_lastIncludePointer, m_lastIncludeDecorations, m_lastIncludeShadow);
+        doGrab(ImagePlatform::ShutterMode::Immediate);
     };
     QObject::connect(delayAnimation, &QVariantAnimation::stateChanged,
                      this, onStateChanged, Qt::QueuedConnection);
@@ -676,13 +669,17 @@ SpectacleCore::SpectacleCore(QObject *parent)
 
     connect(exportManager, &ExportManager::errorMessage, this, &SpectacleCore::showErrorMessage);
 
-    connect(m_annotationDocument.get(), &AnnotationDocument::repaintNeeded, m_annotationSyncTimer.get(), qOverload<>(&QTimer::start));
-    connect(m_annotationSyncTimer.get(), &QTimer::timeout, this, [this] {
-        auto image = m_annotationDocument->renderToImage();
-        auto canvasPos = m_annotationDocument->canvasRect().topLeft();
-        ImageMetaData::setLogicalXY(image, canvasPos.x(), canvasPos.y());
-        ExportManager::instance()->setImage(image);
-    }, Qt::QueuedConnection); // QueuedConnection to help prevent making the visible render lag.
+    // Rendering the whole canvas for every edit is expensive with large captures,
+    // so the export image is only rendered when something needs it.
+    connect(m_annotationDocument.get(), &AnnotationDocument::repaintNeeded, this, [this] {
+        ++m_annotationRevision;
+        // Background encoding needs the image once the edits settle.
+        if (Settings::encodeImageInBackground()) {
+            m_annotationSyncTimer->start();
+        }
+    });
+    connect(m_annotationSyncTimer.get(), &QTimer::timeout, this, &SpectacleCore::syncExportImage,
+            Qt::QueuedConnection); // QueuedConnection to help prevent making the visible render lag.
 
     // set up shortcuts
     KGlobalAccel::self()->setGlobalShortcut(ShortcutActions::self()->openAction(),
@@ -717,7 +714,22 @@ SpectacleCore::SpectacleCore(QObject *parent)
         if (it != m_captureWindows.end()) {
             m_captureWindows.erase(it);
         }
+        std::erase_if(m_captureWindowPool, [screen](const CaptureWindow::UniquePointer &window) {
+            return window->screenToFollow() == screen || window->screenToFollow() == nullptr;
+        });
+    });
+    connect(qApp, &QApplication::screenAdded, this, [this] {
+        if (m_residentLocker) {
+            QTimer::singleShot(0, this, &SpectacleCore::warmCaptureWindows);
+        }
     });
+    // Prepare windows for the next capture once the current one is done.
+    connect(this, &SpectacleCore::allDone, this, [this] {
+        if (m_residentLocker) {
+            deleteWindows();
+            warmCaptureWindows();
+        }
+    }, Qt::QueuedConnection);
 }
 
 bool SpectacleCore::ocrAvailable() const
@@ -730,6 +742,11 @@ OcrManager::OcrStatus SpectacleCore::ocrStatus() const
     return OcrManager::instance()->status();
 }
 
+OcrResultModel *SpectacleCore::ocrResult() const
+{
+    return OcrManager::instance()->resultModel();
+}
+
 QVariantMap SpectacleCore::ocrAvailableLanguages() const
 {
     auto ocrManager = OcrManager::instance();
@@ -786,7 +803,7 @@ bool SpectacleCore::performOcrExtraction(const QString &languageCode)
         return false;
     }
 
-    const QImage image = m_annotationDocument->renderToImage();
+    const QImage image = exportImage();
     if (image.isNull()) {
         inlineMessages->push(InlineMessageModel::Error, i18nc("@info", "No screenshot available."));
         return false;
@@ -894,30 +911,8 @@ void SpectacleCore::activate(const QStringList &arguments, const QString &workin
 
     // Collect parsed command line options
     using Option = CommandLineOptions::Option;
-    m_cliOptions.fill(false); // reset all values to false
-    int optionsToCheck = parser.optionNames().size();
-    for (int i = 0; optionsToCheck > 0 && i < CommandLineOptions::self()->allOptions.size(); ++i) {
-        m_cliOptions[i] = parser.isSet(CommandLineOptions::self()->allOptions[i]);
-        if (m_cliOptions[i]) {
-            --optionsToCheck;
-        }
-    }
-
-    // Determine start mode
-    m_startMode = StartMode::Gui; // Default to Gui
-    // Gui is an option that's normally useless since it's the default mode.
-    // Make it override the other modes if explicitly set, using the launchonly option,
-    // or editing an existing image. Editing an existing image requires a viewer window.
-    if (!m_cliOptions[Option::Gui]
-        && !m_cliOptions[Option::LaunchOnly]
-        && !m_cliOptions[Option::EditExisting]) {
-        // Background gets precedence over DBus
-        if (m_cliOptions[Option::Background]) {
-            m_startMode = StartMode::Background;
-        } else if (m_cliOptions[Option::DBus]) {
-            m_startMode = StartMode::DBus;
-        }
-    }
+    m_cliOptions = CommandLineOptions::values(parser);
+    m_startMode = CommandLineOptions::startMode(m_cliOptions);
 
     if (parser.optionNames().size() > 0 || m_startMode != StartMode::Gui || !m_returnToViewer) {
         // Delete windows if we have CLI options or not in GUI mode.
@@ -931,52 +926,19 @@ void SpectacleCore::activate(const QStringList &arguments, const QString &workin
         Settings::setSelectionRect({0, 0, 0, 0});
     }
 
-    /* The logic for setting options for each start mode:
-     *
-     * - Gui/DBus: Prioritise command line options and default to saved settings.
-     * - Background: Prioritise command line options and use defaults based on
-     *   how command line options are meant to be used.
-     *
-     * Never start with a delay by default. It is annoying and confuses users
-     * when nothing happens immediately after starting spectacle.
-     */
-
     // In the GUI/CLI, the TransientWithParent mode is represented by the
     // "Window Under Cursor" option and the real WindowUnderCursor mode is
     // represented by the popup-only/transientOnly setting, which is meant to
     // override TransientWithParent. Needless to say, This is rather convoluted.
     // TODO: Improve the API for transientOnly or make it obsolete.
-    bool transientOnly;
-    bool onClick;
-    bool includeDecorations;
-    bool includePointer;
-    bool includeShadow;
-    if (m_startMode == StartMode::Background) {
-        transientOnly = m_cliOptions[Option::TransientOnly];
-        onClick = m_cliOptions[Option::OnClick];
-        includeDecorations = !m_cliOptions[Option::NoDecoration];
-        includePointer = m_cliOptions[Option::Pointer];
-        includeShadow = !m_cliOptions[Option::NoShadow];
-    } else {
-        transientOnly = Settings::transientOnly() || m_cliOptions[Option::TransientOnly];
-        onClick = Settings::captureOnClick() || m_cliOptions[Option::OnClick];
-        includeDecorations = Settings::includeDecorations()
-                            && !m_cliOptions[Option::NoDecoration];
-        includeShadow = Settings::includeShadow() && !m_cliOptions[Option::NoShadow];
-        includePointer = Settings::includePointer() || m_cliOptions[Option::Pointer];
-    }
-    onClick &= m_imagePlatform->supportedShutterModes().testFlag(ImagePlatform::OnClick);
-
-    int delayMsec = 0; // default to 0 if cli value parse fails
-    if (onClick) {
-        delayMsec = -1;
-    } else if (m_cliOptions[Option::Delay]) {
-        bool parseOk = false;
-        int value = parser.value(CommandLineOptions::self()->delay).toInt(&parseOk);
-        if (parseOk) {
-            delayMsec = value;
-        }
-    }
+    const auto captureSettings = CommandLineOptions::captureSettings(m_startMode, m_cliOptions);
+    const bool transientOnly = captureSettings.transientOnly;
+    const bool onClick = captureSettings.onClick && m_imagePlatform->supportedShutterModes().testFlag(ImagePlatform::OnClick);
+    const bool includeDecorations = captureSettings.includeDecorations;
+    const bool includeShadow = captureSettings.includeShadow;
+    bool includePointer = captureSettings.includePointer;
+
+    const int delayMsec = CommandLineOptions::delay(parser, onClick);
 
     if (m_cliOptions[Option::EditExisting]) {
         auto input = parser.value(CommandLineOptions::self()->editExisting);
@@ -1006,34 +968,11 @@ void SpectacleCore::activate(const QStringList &arguments, const QString &workin
         m_editExistingUrl.clear();
     }
 
-    if (m_cliOptions[Option::Output]) {
-        m_outputUrl = QUrl::fromUserInput(parser.value(CommandLineOptions::self()->output),
-                                          QDir::currentPath(), QUrl::AssumeLocalFile);
-        if (!m_outputUrl.isValid()) {
-            m_cliOptions[Option::Output] = false;
-            m_outputUrl.clear();
-        }
-    } else {
-        m_outputUrl.clear();
-    }
+    m_outputUrl = CommandLineOptions::outputUrl(parser, m_cliOptions);
 
     // Determine grab mode
     using CaptureMode = CaptureModeModel::CaptureMode;
     using GrabMode = ImagePlatform::GrabMode;
-    auto cliGrabMode = [&]() -> std::optional<GrabMode> {
-        if (m_cliOptions[Option::Fullscreen]) {
-            return m_cliOptions[Option::Scaled] ? GrabMode::AllScreensScaled : GrabMode::AllScreens;
-        } else if (m_cliOptions[Option::Current]) {
-            return GrabMode::CurrentScreen;
-        } else if (m_cliOptions[Option::ActiveWindow]) {
-            return GrabMode::ActiveWindow;
-        } else if (m_cliOptions[Option::Region]) {
-            return GrabMode::PerScreenImageNative;
-        } else if (m_cliOptions[Option::WindowUnderCursor]) {
-            return GrabMode::WindowUnderCursor;
-        }
-        return std::nullopt;
-    };
     auto launchActionGrabMode = [&] {
         switch (Settings::launchAction()) {
         case Settings::TakeRectangularScreenshot:
@@ -1046,11 +985,7 @@ void SpectacleCore::activate(const QStringList &arguments, const QString &workin
             return GrabMode::NoGrabModes;
         }
     };
-    auto grabMode = cliGrabMode().value_or(m_startMode == StartMode::Background ? GrabMode::AllScreens : launchActionGrabMode());
-
-    if (m_cliOptions[Option::Scaled] && !m_cliOptions[Option::Fullscreen]) {
-        qWarning().noquote() << i18nc("@info:shell", "--scaled is only allowed together with -f/--fullscreen and will be ignored");
-    }
+    auto grabMode = CommandLineOptions::grabMode(m_cliOptions).value_or(m_startMode == StartMode::Background ? GrabMode::AllScreens : launchActionGrabMode());
 
     using RecordingMode = VideoPlatform::RecordingMode;
     RecordingMode recordingMode = RecordingMode::NoRecordingModes;
@@ -1100,6 +1035,11 @@ void SpectacleCore::activate(const QStringList &arguments, const QString &workin
     case StartMode::Background:
         if (m_videoMode) {
             startRecording(recordingMode, includePointer);
+        } else if (m_cliOptions[Option::Region] && !Settings::selectionRect().isEmpty()
+                   && m_imagePlatform->supportedGrabModes().testFlag(ImagePlatform::Area)) {
+            // The remembered region is only kept when rememberSelectionRect is Always.
+            // There is nothing for the user to adjust, so capture it directly.
+            takeNewScreenshot(Settings::selectionRect().toAlignedRect(), delayMsec, includePointer);
         } else {
             takeNewScreenshot(grabMode, delayMsec, includePointer, includeDecorations, includeShadow);
         }
@@ -1178,33 +1118,18 @@ void SpectacleCore::takeNewScreenshot(ImagePlatform::GrabMode grabMode, int time
         && m_imagePlatform->supportedShutterModes().testFlag(ImagePlatform::OnClick)
     ) {
         SpectacleWindow::setVisibilityForAll(QWindow::Hidden);
-        m_imagePlatform->doGrab(ImagePlatform::ShutterMode::OnClick, m_lastGrabMode, m_lastIncludePointer, m_lastIncludeDecorations, m_lastIncludeShadow);
+        doGrab(ImagePlatform::ShutterMode::OnClick);
         return;
     }
 
     timeout = qMax(0, timeout);
     const bool noDelay = timeout == 0;
-#if WITH_X11
-    if (PlasmaVersion::get() < PlasmaVersion::check(5, 27, 4) && KX11Extras::compositingActive()) {
-        // when compositing is enabled, we need to give it enough time for the window
-        // to disappear and all the effects are complete before we take the shot. there's
-        // no way of knowing how long the disappearing effects take, but as per default
-        // settings (and unless the user has set an extremely slow effect), 200
-        // milliseconds is a good amount of wait time.
-        timeout = qMax(timeout, 200);
-    } else if (qobject_cast<ImagePlatformXcb *>(m_imagePlatform.get())) {
-        // X11 compositors (which may or may not be kwin) require small delay for
-        // window to disappear.
-        // Also, minimum 50ms delay is needed to prevent segfaults from xcb function
-        // calls that don't get replies fast enough.
-        timeout = qMax(timeout, 50);
-    }
-#endif
+    timeout = qMax(timeout, m_imagePlatform->minimumCaptureDelay());
 
     if (noDelay) {
         SpectacleWindow::setVisibilityForAll(QWindow::Hidden);
         QTimer::singleShot(timeout, this, [this]() {
-            m_imagePlatform->doGrab(ImagePlatform::ShutterMode::Immediate, m_lastGrabMode, m_lastIncludePointer, m_lastIncludeDecorations, m_lastIncludeShadow);
+            doGrab(ImagePlatform::ShutterMode::Immediate);
         });
         return;
     }
@@ -1217,6 +1142,27 @@ void SpectacleCore::takeNewScreenshot(ImagePlatform::GrabMode grabMode, int time
     SpectacleWindow::setVisibilityForAll(QWindow::Minimized);
 }
 
+void SpectacleCore::takeNewScreenshot(const QRect &area, int timeout, bool includePointer)
+{
+    if (area.isEmpty() || !m_imagePlatform->supportedGrabModes().testFlag(ImagePlatform::Area)) {
+        // Let the user select the area instead.
+        takeNewScreenshot(toGrabMode(CaptureModeModel::RectangularRegion, false), timeout, includePointer, false, false);
+        return;
+    }
+    m_lastGrabArea = area;
+    // Area captures are never interactive, so don't let a negative timeout switch to on click.
+    takeNewScreenshot(ImagePlatform::GrabMode::Area, qMax(0, timeout), includePointer, false, false);
+}
+
+void SpectacleCore::doGrab(ImagePlatform::ShutterMode shutterMode)
+{
+    if (m_lastGrabMode == ImagePlatform::GrabMode::Area) {
+        m_imagePlatform->doGrabArea(m_lastGrabArea, m_lastIncludePointer);
+    } else {
+        m_imagePlatform->doGrab(shutterMode, m_lastGrabMode, m_lastIncludePointer, m_lastIncludeDecorations, m_lastIncludeShadow);
+    }
+}
+
 void SpectacleCore::takeNewScreenshot(int captureMode, int timeout, bool includePointer, bool includeDecorations, bool includeShadow)
 {
     using CaptureMode = CaptureModeModel::CaptureMode;
@@ -1374,27 +1320,7 @@ void SpectacleCore::doNotify(ScreenCapture type, const ExportManager::Actions &a
 
 ExportManager::Actions SpectacleCore::autoExportActions() const
 {
-    using Action = ExportManager::Action;
-    using Option = CommandLineOptions::Option;
-    bool save = (m_startMode != StartMode::Gui && m_cliOptions[Option::Output]) || m_videoMode;
-    bool copyImage = m_cliOptions[Option::CopyImage] && !m_videoMode;
-    bool copyPath = m_cliOptions[Option::CopyPath];
-    ExportManager::Actions actions;
-    if (m_startMode != StartMode::Background) {
-        save |= Settings::autoSaveImage();
-        copyImage |= Settings::clipboardGroup() == Settings::PostScreenshotCopyImage && !m_videoMode;
-        copyPath |= Settings::clipboardGroup() == Settings::PostScreenshotCopyLocation;
-    }
-    if (m_startMode == StartMode::Gui) {
-        actions.setFlag(Action::Save, save);
-        actions.setFlag(Action::CopyImage, copyImage);
-    } else {
-        // In background and dbus mode, ensure that either save or copy image is enabled.
-        actions.setFlag(Action::Save, save || !copyImage);
-        actions.setFlag(Action::CopyImage, !actions.testFlag(Action::Save) || copyImage);
-    }
-    actions.setFlag(Action::CopyPath, actions.testFlag(Action::Save) && copyPath);
-    return actions;
+    return CommandLineOptions::autoExportActions(m_startMode, m_cliOptions, m_videoMode);
 }
 
 ImagePlatform::GrabMode SpectacleCore::toGrabMode(CaptureModeModel::CaptureMode captureMode, bool transientOnly) const
@@ -1439,7 +1365,7 @@ CaptureModeModel::CaptureMode SpectacleCore::toCaptureMode(ImagePlatform::GrabMo
         return CaptureMode::ActiveWindow;
     } else if (grabMode == GrabMode::WindowUnderCursor) {
         return CaptureMode::WindowUnderCursor;
-    } else if (grabMode == GrabMode::PerScreenImageNative) {
+    } else if (grabMode == GrabMode::PerScreenImageNative || grabMode == GrabMode::Area) {
         return CaptureMode::RectangularRegion;
     } else if (grabMode == GrabMode::AllScreensScaled) {
         return CaptureMode::AllScreensScaled;
@@ -1463,10 +1389,11 @@ void SpectacleCore::initGuiNoScreenshot()
     ViewerWindow::instance()->setVisible(true);
 }
 
-// Hurry up the sync if the sync timer is active.
+// Render the export image if the annotations changed since it was last set.
+// This renders at most once per revision of the annotation document.
 void SpectacleCore::syncExportImage()
 {
-    if (!m_annotationSyncTimer->isActive()) {
+    if (m_exportImageRevision == m_annotationRevision) {
         return;
     }
     auto image = m_annotationDocument->renderToImage();
@@ -1475,10 +1402,17 @@ void SpectacleCore::syncExportImage()
     setExportImage(image);
 }
 
+QImage SpectacleCore::exportImage()
+{
+    syncExportImage();
+    return ExportManager::instance()->image();
+}
+
 // A convenient way to stop the sync timer and set the export image.
 void SpectacleCore::setExportImage(const QImage &image)
 {
     m_annotationSyncTimer->stop();
+    m_exportImageRevision = m_annotationRevision;
     ExportManager::instance()->setImage(image);
 }
 
@@ -1509,10 +1443,80 @@ void SpectacleCore::initCaptureWindows(CaptureWindow::Mode mode)
             && !screenRect.intersects(m_annotationDocument->canvasRect())) {
             continue;
         }
+        if (mode == CaptureWindow::Image) {
+            if (auto window = takePooledCaptureWindow(screen)) {
+                m_captureWindows.emplace_back(std::move(window));
+                continue;
+            }
+        }
         m_captureWindows.emplace_back(CaptureWindow::makeUnique(mode, screen, engine));
     }
 }
 
+CaptureWindow::UniquePointer SpectacleCore::takePooledCaptureWindow(QScreen *screen)
+{
+    auto it = std::find_if(m_captureWindowPool.begin(), m_captureWindowPool.end(), [screen](const CaptureWindow::UniquePointer &window) {
+        return window->screenToFollow() == screen;
+    });
+    if (it == m_captureWindowPool.end()) {
+        return {nullptr, nullptr};
+    }
+    auto window = std::move(*it);
+    m_captureWindowPool.erase(it);
+    window->setPooled(false);
+    return window;
+}
+
+void SpectacleCore::warmCaptureWindows()
+{
+    // Don't create windows while a capture is using them.
+    if (!m_residentLocker || !m_captureWindows.empty() || m_videoPlatform->isRecording()) {
+        return;
+    }
+    QQuickWindow::setDefaultAlphaBuffer(true);
+    auto engine = getQmlEngine();
+    const auto screens = qApp->screens();
+    for (auto *screen : screens) {
+        const bool pooled = std::any_of(m_captureWindowPool.cbegin(), m_captureWindowPool.cend(), [screen](const CaptureWindow::UniquePointer &window) {
+            return window->screenToFollow() == screen;
+        });
+        if (!pooled) {
+            m_captureWindowPool.emplace_back(CaptureWindow::makePooled(CaptureWindow::Image, screen, engine));
+        }
+    }
+}
+
+bool SpectacleCore::isResident() const
+{
+    return m_residentLocker != nullptr;
+}
+
+void SpectacleCore::setResident(bool resident)
+{
+    if (isResident() == resident) {
+        return;
+    }
+    if (resident) {
+        // Keep the event loop running when the last window is closed.
+        m_residentLocker = std::make_unique<QEventLoopLocker>();
+        QTimer::singleShot(0, this, &SpectacleCore::warmCaptureWindows);
+    } else {
+        m_captureWindowPool.clear();
+        m_residentLocker.reset();
+    }
+}
+
+void SpectacleCore::startAgent()
+{
+    m_agentStarted = true;
+    setResident(true);
+}
+
+bool SpectacleCore::isAgentStarted() const
+{
+    return m_agentStarted;
+}
+
 void SpectacleCore::initViewerWindow(ViewerWindow::Mode mode)
 {
     // always switch to gui mode when a viewer window is used.
@@ -1529,6 +1533,15 @@ void SpectacleCore::initViewerWindow(ViewerWindow::Mode mode)
 void SpectacleCore::deleteWindows()
 {
     m_viewerWindow.reset();
+    if (m_residentLocker) {
+        // Video capture windows change their window behavior, so only image capture windows are reused.
+        for (auto &window : m_captureWindows) {
+            if (window && window->mode() == CaptureWindow::Image && window->screenToFollow()) {
+                window->setPooled(true);
+                m_captureWindowPool.emplace_back(std::move(window));
+            }
+        }
+    }
     m_captureWindows.clear();
 }
 
@@ -44,13 +44,10 @@ class SpectacleCore : public QObject
     Q_PROPERTY(AnnotationDocument *annotationDocument READ annotationDocument CONSTANT FINAL)
     Q_PROPERTY(bool ocrAvailable READ ocrAvailable NOTIFY ocrStatusChanged FINAL)
     Q_PROPERTY(OcrManager::OcrStatus ocrStatus READ ocrStatus NOTIFY ocrStatusChanged FINAL)
+    Q_PROPERTY(OcrResultModel *ocrResult READ ocrResult CONSTANT FINAL)
 
 public:
-    enum class StartMode {
-        Gui = 0,
-        DBus = 1,
-        Background = 2,
-    };
+    using StartMode = CommandLineOptions::StartMode;
 
     ~SpectacleCore() noexcept override;
 
@@ -80,6 +77,7 @@ public:
 
     bool ocrAvailable() const;
     OcrManager::OcrStatus ocrStatus() const;
+    OcrResultModel *ocrResult() const;
     Q_INVOKABLE QVariantMap ocrAvailableLanguages() const;
     Q_INVOKABLE bool startOcrExtraction(const QString &languageCode = QString());
 
@@ -87,6 +85,12 @@ public:
 
     void syncExportImage();
 
+    /**
+     * The image to export, with the current annotations.
+     * It's only rendered when the annotations changed since the last call.
+     */
+    QImage exportImage();
+
     Q_INVOKABLE void startRecording(VideoPlatform::RecordingMode mode, bool withPointer = Settings::videoIncludePointer());
     Q_INVOKABLE void finishRecording();
 
@@ -94,8 +98,30 @@ public:
 
     ExportManager::Actions autoExportActions() const;
 
+    /**
+     * Take a screenshot of only the given area in logical coordinates.
+     * This is used for captures where the area is already known, such as automation or
+     * repeated captures of the same area, so there is no need to grab every screen and crop.
+     */
+    void takeNewScreenshot(const QRect &area, int timeout, bool includePointer);
+
     void activateAction(const QString &actionName, const QVariant &parameter);
 
+    /**
+     * Whether Spectacle keeps running after all captures are done.
+     * While resident, hidden capture windows are kept loaded for every screen,
+     * so showing the region capture UI doesn't have to create windows and QML.
+     */
+    bool isResident() const;
+    void setResident(bool resident);
+
+    /**
+     * Become resident until Spectacle quits, regardless of the run in background setting.
+     * This is what the StartAgent DBus method does.
+     */
+    void startAgent();
+    bool isAgentStarted() const;
+
     static SpectacleCore *create(QQmlEngine *engine, QJSEngine *)
     {
         auto inst = instance();
@@ -144,6 +170,7 @@ private:
     };
 
     void takeNewScreenshot(ImagePlatform::GrabMode grabMode, int timeout, bool includePointer, bool includeDecorations, bool includeShadow);
+    void doGrab(ImagePlatform::ShutterMode shutterMode);
     void setExportImage(const QImage &image);
     void showViewerIfGuiMode(bool minimized = false);
     void doNotify(ScreenCapture type, const ExportManager::Actions &actions, const QUrl &saveUrl);
@@ -154,6 +181,8 @@ private:
     void initCaptureWindows(CaptureWindow::Mode mode);
     void initViewerWindow(ViewerWindow::Mode mode);
     void deleteWindows();
+    void warmCaptureWindows();
+    CaptureWindow::UniquePointer takePooledCaptureWindow(QScreen *screen);
     void unityLauncherUpdate(const QVariantMap &properties) const;
     void setCurrentVideo(const QUrl &currentVideo);
     QUrl videoOutputUrl() const;
@@ -170,6 +199,10 @@ private:
     std::unique_ptr<VideoPlatform> m_videoPlatform;
     std::unique_ptr<QQmlEngine> m_engine;
     std::unique_ptr<QTimer> m_annotationSyncTimer;
+    // Incremented for every change to the annotation document.
+    quint64 m_annotationRevision = 0;
+    // The annotation revision that the export image was rendered from.
+    quint64 m_exportImageRevision = 0;
     std::unique_ptr<QVariantAnimation> m_delayAnimation;
     std::unique_ptr<QEventLoopLocker> m_eventLoopLocker;
 
@@ -181,13 +214,18 @@ private:
     // For some reason, removeIf/erase_if/find_if then erase doesn't work with QList/QList,
     // so we have to use std::vector. Something about use of a deleted unique_ptr function.
     std::vector<CaptureWindow::UniquePointer> m_captureWindows;
+    // Hidden image capture windows kept for reuse while resident.
+    std::vector<CaptureWindow::UniquePointer> m_captureWindowPool;
+    std::unique_ptr<QEventLoopLocker> m_residentLocker;
+    bool m_agentStarted = false;
 
-    std::array<bool, CommandLineOptions::TotalOptions> m_cliOptions = {};
+    CommandLineOptions::Values m_cliOptions = {};
 
     QUrl m_editExistingUrl;
     QUrl m_outputUrl;
 
     ImagePlatform::GrabMode m_lastGrabMode = ImagePlatform::GrabMode::NoGrabModes;
+    QRect m_lastGrabArea; // only used with ImagePlatform::GrabMode::Area
     bool m_lastIncludePointer = false; // cli default value
     bool m_lastIncludeDecorations = true; // cli default value
     bool m_lastIncludeShadow = true; // cli default value
@@ -18,6 +18,11 @@ inline SpectacleCore *SpectacleDBusAdapter::parent() const
     return static_cast<SpectacleCore *>(QObject::parent());
 }
 
+void SpectacleDBusAdapter::StartAgent()
+{
+    parent()->startAgent();
+}
+
 void SpectacleDBusAdapter::FullScreen(int includeMousePointer)
 {
     parent()->takeNewScreenshot(CaptureModeModel::AllScreens, 0, (includeMousePointer == -1) ? Settings::includePointer() : includeMousePointer, true);
@@ -54,6 +59,11 @@ void SpectacleDBusAdapter::RectangularRegion(int includeMousePointer)
                                 false);
 }
 
+void SpectacleDBusAdapter::Area(int x, int y, int width, int height, int includeMousePointer)
+{
+    parent()->takeNewScreenshot(QRect(x, y, width, height), 0, (includeMousePointer == -1) ? Settings::includePointer() : includeMousePointer);
+}
+
 void SpectacleDBusAdapter::RecordRegion(int includeMousePointer)
 {
     parent()->startRecording(VideoPlatform::Region, includeMousePointer == -1 ? Settings::videoIncludePointer() : includeMousePointer);
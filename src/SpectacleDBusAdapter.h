@@ -20,11 +20,13 @@ public:
 
 public Q_SLOTS:
 
+    Q_NOREPLY void StartAgent();
     Q_NOREPLY void FullScreen(int includeMousePointer);
     Q_NOREPLY void CurrentScreen(int includeMousePointer);
     Q_NOREPLY void ActiveWindow(int includeWindowDecorations, int includeMousePointer, int includeWindowShadow);
     Q_NOREPLY void WindowUnderCursor(int includeWindowDecorations, int includeMousePointer, int includeWindowShadow);
     Q_NOREPLY void RectangularRegion(int includeMousePointer);
+    Q_NOREPLY void Area(int x, int y, int width, int height, int includeMousePointer);
     Q_NOREPLY void RecordRegion(int includeMousePointer);
     Q_NOREPLY void RecordScreen(int includeMousePointer);
     Q_NOREPLY void RecordWindow(int includeMousePointer);
@@ -0,0 +1,115 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-only OR LGPL-2.0-only OR LicenseRef-KDE-Accepted-GPL
+ */
+
+#include <QGraphicsDropShadowEffect>
+#include <QGraphicsPixmapItem>
+#include <QGraphicsScene>
+#include <QPainter>
+#include <QTest>
+
+#include "DropShadow.h"
+
+class DropShadowBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    // The QGraphicsScene based implementation DropShadow replaced, for comparison.
+    static QImage graphicsEffectDropShadow(const QImage &image);
+    static QImage windowImage(const QSize &size);
+
+private Q_SLOTS:
+    void testShadow();
+    void benchmark_data();
+    void benchmark();
+};
+
+QImage DropShadowBenchmark::graphicsEffectDropShadow(const QImage &image)
+{
+    QImage shadowImage(image.size() + QSize(40, 40), QImage::Format_ARGB32);
+    shadowImage.fill(Qt::transparent);
+    QPainter shadowPainter(&shadowImage);
+
+    auto pixmapItem = new QGraphicsPixmapItem;
+    pixmapItem->setPixmap(QPixmap::fromImage(image));
+    auto shadowEffect = new QGraphicsDropShadowEffect;
+    shadowEffect->setOffset(0);
+    shadowEffect->setBlurRadius(20);
+    pixmapItem->setGraphicsEffect(shadowEffect);
+
+    QGraphicsScene graphicsScene;
+    graphicsScene.addItem(pixmapItem);
+    graphicsScene.render(&shadowPainter, QRectF(), QRectF(-20, -20, image.width() + 40, image.height() + 40));
+    shadowPainter.end();
+    return shadowImage;
+}
+
+QImage DropShadowBenchmark::windowImage(const QSize &size)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(Qt::white);
+    painter.drawRoundedRect(QRectF(QPointF(0, 0), size), 8, 8);
+    return image;
+}
+
+void DropShadowBenchmark::testShadow()
+{
+    const DropShadow dropShadow;
+    const auto image = windowImage({200, 100});
+    const auto result = dropShadow.apply(image);
+    QCOMPARE(result.size(), image.size() + QSize(40, 40));
+
+    // The image is drawn unchanged on top of the shadow.
+    QCOMPARE(result.pixel(120, 70), image.pixel(100, 50));
+
+    // The shadow fades out with the distance to the image.
+    const int nearAlpha = qAlpha(result.pixel(19, 70));
+    const int farAlpha = qAlpha(result.pixel(5, 70));
+    QVERIFY(nearAlpha > farAlpha);
+    QVERIFY(nearAlpha <= 180);
+    QVERIFY(qAlpha(result.pixel(0, 0)) < farAlpha);
+}
+
+void DropShadowBenchmark::benchmark_data()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<bool>("graphicsEffect");
+    QList<QSize> sizes = {{640, 480}, {1920, 1080}};
+    // The QGraphicsScene rows for large windows are slow, so only add them when asked to.
+    if (qEnvironmentVariableIsSet("SPECTACLE_BENCHMARK_LARGE")) {
+        sizes = {{640, 480}, {1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+    }
+    for (const auto &size : sizes) {
+        const auto name = QByteArray::number(size.width()) + 'x' + QByteArray::number(size.height());
+        QTest::newRow((name + " DropShadow").constData()) << size << false;
+        QTest::newRow((name + " QGraphicsDropShadowEffect").constData()) << size << true;
+    }
+}
+
+void DropShadowBenchmark::benchmark()
+{
+    QFETCH(QSize, size);
+    QFETCH(bool, graphicsEffect);
+    const DropShadow dropShadow;
+    const auto image = windowImage(size);
+    QImage result;
+    if (graphicsEffect) {
+        QBENCHMARK {
+            result = graphicsEffectDropShadow(image);
+        }
+    } else {
+        QBENCHMARK {
+            result = dropShadow.apply(image);
+        }
+    }
+    QCOMPARE(result.size(), image.size() + QSize(40, 40));
+}
+
+QTEST_MAIN(DropShadowBenchmark)
+
+#include "DropShadowBenchmark.moc"
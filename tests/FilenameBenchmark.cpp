@@ -0,0 +1,90 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-only OR LGPL-2.0-only OR LicenseRef-KDE-Accepted-GPL
+ */
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThread>
+
+#include "DirectoryIndex.h"
+#include "ExportManager.h"
+
+using namespace Qt::StringLiterals;
+
+class FilenameBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void benchmarkFormatting_data();
+    void benchmarkFormatting();
+    void benchmarkNumbering_data();
+    void benchmarkNumbering();
+};
+
+void FilenameBenchmark::benchmarkFormatting_data()
+{
+    QTest::addColumn<QString>("filenameTemplate");
+    QTest::addColumn<QString>("title");
+    QTest::newRow("default") << Settings::defaultImageFilenameTemplateValue() << u"Spectacle"_s;
+    QTest::newRow("many placeholders") << u"<title>/<yyyy>-<MM>-<dd>/<HH>.<mm>.<ss>.<zzz>_<h><AP>_<UnixTime>_<t>"_s << u"Spectacle"_s;
+    // '<' outside of a placeholder is kept as literal text.
+    QTest::newRow("many placeholders (stray bracket)") << u"<title>/<yyyy>-<MM>-<dd>/<HH>.<mm>.<ss>.<zzz>_<h><AP>_<UnixTime>_<t><"_s << u"Spectacle"_s;
+}
+
+// Filenames are formatted for every autosave, temporary file and Save As suggestion.
+void FilenameBenchmark::benchmarkFormatting()
+{
+    QFETCH(QString, filenameTemplate);
+    QFETCH(QString, title);
+    const auto timestamp = QDateTime::currentDateTime();
+    QBENCHMARK {
+        ExportManager::formattedFilename(filenameTemplate, timestamp, title);
+    }
+}
+
+void FilenameBenchmark::benchmarkNumbering_data()
+{
+    QTest::addColumn<int>("fileCount");
+    QTest::newRow("100 files") << 100;
+    QTest::newRow("1000 files") << 1000;
+    QTest::newRow("10000 files") << 10000;
+    // Creating this many files takes a while, so only do it when asked to.
+    if (qEnvironmentVariableIsSet("SPECTACLE_BENCHMARK_LARGE")) {
+        QTest::newRow("100000 files") << 100000;
+    }
+}
+
+// The cost of naming and saving a numbered screenshot shouldn't grow with the number of files in the directory.
+void FilenameBenchmark::benchmarkNumbering()
+{
+    QFETCH(int, fileCount);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    for (int i = 1; i <= fileCount; ++i) {
+        QFile file(dir.filePath(u"Screenshot_%1.png"_s.arg(i)));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+    // Let the directory's modification time settle, like it would between captures.
+    QThread::msleep(100);
+
+    const auto saveLocation = QUrl::fromLocalFile(dir.path());
+    int nextNumber = fileCount + 1;
+    QBENCHMARK {
+        const auto name = ExportManager::formattedFilename(u"Screenshot_<#>"_s, {}, {}, saveLocation);
+        QCOMPARE(name, u"Screenshot_%1"_s.arg(nextNumber));
+        // Save the file like ExportManager does.
+        const auto path = dir.filePath(name + u".png"_s);
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.close();
+        DirectoryIndex::instance()->insert(QUrl::fromLocalFile(path));
+        ++nextNumber;
+    }
+}
+
+QTEST_GUILESS_MAIN(FilenameBenchmark)
+
+#include "FilenameBenchmark.moc"
@@ -29,6 +29,8 @@ private Q_SLOTS:
     void testWindowTitle();
     void testNumbering();
     void testCombined();
+    void testTemplateCompatibility_data();
+    void testTemplateCompatibility();
 };
 
 void FilenameTest::initTestCase()
@@ -134,6 +136,40 @@ void FilenameTest::testCombined()
              u"App/Date_20190322_Time_08:43:25PM<notaplaceholder>"_s);
 }
 
+void FilenameTest::testTemplateCompatibility_data()
+{
+    QTest::addColumn<QString>("filenameTemplate");
+    QTest::addColumn<QString>("title");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("repeated") << u"<mm><mm>/<mm>"_s << QString() << u"4343/43"_s;
+    QTest::newRow("adjacent") << u"<yyyy><MM><dd><HH><mm><ss>"_s << QString() << u"20190322204325"_s;
+    QTest::newRow("12 hour and unix time") << u"<h>_<hh>_<UnixTime>"_s << QString() << u"8_08_1553287405"_s;
+    QTest::newRow("nested brackets") << u"<<mm>>"_s << QString() << u"<43>"_s;
+    QTest::newRow("unmatched open") << u"<m<mm>"_s << QString() << u"<m43"_s;
+    QTest::newRow("unmatched close") << u"<mm>>_>"_s << QString() << u"43>_>"_s;
+    QTest::newRow("unknown placeholder") << u"<notaplaceholder>_<mm>"_s << QString() << u"<notaplaceholder>_43"_s;
+    QTest::newRow("duplicate separators") << u"a//<title>//<mm>"_s << u"b/c"_s << u"a/b_c/43"_s;
+    QTest::newRow("leading and trailing separators") << u"/<title>/<mm>/"_s << QString() << u"43"_s;
+    // The title is inserted as is, so brackets in the title can't form placeholders.
+    QTest::newRow("placeholder in title") << u"<title>_<mm>"_s << u"<ss>"_s << u"<ss>_43"_s;
+    QTest::newRow("partial placeholder in title") << u"<title>mm>"_s << u"<"_s << u"<mm>"_s;
+}
+
+void FilenameTest::testTemplateCompatibility()
+{
+    QFETCH(QString, filenameTemplate);
+    QFETCH(QString, title);
+    QFETCH(QString, expected);
+    QCOMPARE(mExportManager->formattedFilename(filenameTemplate, timestamp, title), expected);
+    // The second call uses the cached template.
+    QCOMPARE(mExportManager->formattedFilename(filenameTemplate, timestamp, title), expected);
+    // Without a timestamp, timestamp placeholders are kept.
+    if (title.isEmpty() && !filenameTemplate.contains(u"<title>"_s)) {
+        QCOMPARE(mExportManager->formattedFilename(filenameTemplate, {}, title), filenameTemplate);
+    }
+}
+
 QTEST_GUILESS_MAIN(FilenameTest)
 
 #include "FilenameTest.moc"
@@ -0,0 +1,210 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-only OR LGPL-2.0-only OR LicenseRef-KDE-Accepted-GPL
+ */
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QProcess>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "CommandLineOptions.h"
+#include "HeadlessCapture.h"
+
+using namespace Qt::StringLiterals;
+
+// Emits a generated image instead of grabbing the screen.
+class TestImagePlatform : public ImagePlatform
+{
+    Q_OBJECT
+
+public:
+    explicit TestImagePlatform(const QSize &size, QObject *parent = nullptr)
+        : ImagePlatform(parent)
+    {
+        m_image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+        QPainter painter(&m_image);
+        QLinearGradient gradient(0, 0, size.width(), size.height());
+        gradient.setColorAt(0, Qt::darkBlue);
+        gradient.setColorAt(1, Qt::darkGreen);
+        painter.fillRect(m_image.rect(), gradient);
+        painter.end();
+        // Add some detail, so encoding isn't unrealistically cheap.
+        for (int y = 0; y < size.height(); ++y) {
+            auto line = reinterpret_cast<QRgb *>(m_image.scanLine(y));
+            for (int x = (y * 7) % 13; x < size.width(); x += 13) {
+                line[x] = qRgb(x % 256, y % 256, (x ^ y) % 256);
+            }
+        }
+    }
+
+    GrabModes supportedGrabModes() const override
+    {
+        return AllScreens | CurrentScreen | AllScreensScaled;
+    }
+
+    ShutterModes supportedShutterModes() const override
+    {
+        return Immediate;
+    }
+
+public Q_SLOTS:
+    void doGrab(ImagePlatform::ShutterMode, ImagePlatform::GrabMode, bool, bool, bool) override
+    {
+        Q_EMIT newScreenshotTaken(m_image);
+    }
+
+private:
+    QImage m_image;
+};
+
+class HeadlessCaptureBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    // Run spectacle -b -n -o <filePath> in-process and return the exit code.
+    static int capture(const QSize &size, const QString &filePath);
+
+private Q_SLOTS:
+    void initTestCase();
+    void testCanHandle_data();
+    void testCanHandle();
+    void testExportFailure();
+    void benchmarkCapture_data();
+    void benchmarkCapture();
+    void benchmarkProcess();
+
+private:
+    QTemporaryDir m_dir;
+};
+
+int HeadlessCaptureBenchmark::capture(const QSize &size, const QString &filePath)
+{
+    QCommandLineParser parser;
+    parser.addOptions(CommandLineOptions::self()->allOptions);
+    parser.parse({u"spectacle"_s, u"-b"_s, u"-n"_s, u"-o"_s, filePath});
+
+    HeadlessCapture headlessCapture(std::make_unique<TestImagePlatform>(size));
+    QSignalSpy finishedSpy(&headlessCapture, &HeadlessCapture::finished);
+    headlessCapture.start(parser);
+    if (!finishedSpy.wait(10000)) {
+        return -1;
+    }
+    return finishedSpy.constFirst().constFirst().toInt();
+}
+
+void HeadlessCaptureBenchmark::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    // Same as the headless path in Main.cpp, so released export locks don't quit the test.
+    QCoreApplication::setQuitLockEnabled(false);
+}
+
+void HeadlessCaptureBenchmark::testCanHandle_data()
+{
+    QTest::addColumn<QStringList>("arguments");
+    QTest::addColumn<bool>("result");
+    QTest::newRow("background, no notify") << QStringList{u"-b"_s, u"-n"_s} << true;
+    QTest::newRow("background, no notify, output") << QStringList{u"-b"_s, u"-n"_s, u"-o"_s, u"a.png"_s} << true;
+    QTest::newRow("background, no notify, window") << QStringList{u"-b"_s, u"-n"_s, u"-a"_s} << true;
+    QTest::newRow("background") << QStringList{u"-b"_s, u"-o"_s, u"a.png"_s} << false;
+    QTest::newRow("no notify") << QStringList{u"-n"_s} << false;
+    QTest::newRow("region") << QStringList{u"-b"_s, u"-n"_s, u"-r"_s} << false;
+    QTest::newRow("gui") << QStringList{u"-b"_s, u"-n"_s, u"-g"_s} << false;
+}
+
+void HeadlessCaptureBenchmark::testCanHandle()
+{
+    QFETCH(QStringList, arguments);
+    QFETCH(bool, result);
+    QCommandLineParser parser;
+    parser.addOptions(CommandLineOptions::self()->allOptions);
+    arguments.prepend(u"spectacle"_s);
+    QVERIFY(parser.parse(arguments));
+    QCOMPARE(HeadlessCapture::canHandle(parser), result);
+}
+
+// Scripts rely on the exit code, so a failed save must not exit with 0.
+void HeadlessCaptureBenchmark::testExportFailure()
+{
+    // A regular file can't be a parent directory, even for root.
+    const auto blockingFilePath = m_dir.filePath(u"not-a-directory"_s);
+    QFile blockingFile(blockingFilePath);
+    QVERIFY(blockingFile.open(QIODevice::WriteOnly));
+    blockingFile.close();
+
+    const auto filePath = blockingFilePath + u"/capture.png"_s;
+    QCOMPARE(capture({640, 480}, filePath), 1);
+    QVERIFY(!QFile::exists(filePath));
+}
+
+void HeadlessCaptureBenchmark::benchmarkCapture_data()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::newRow("1920x1080") << QSize(1920, 1080);
+    QTest::newRow("3840x2160") << QSize(3840, 2160);
+    QTest::newRow("7680x2160") << QSize(7680, 2160);
+}
+
+void HeadlessCaptureBenchmark::benchmarkCapture()
+{
+    QFETCH(QSize, size);
+    int i = 0;
+    QBENCHMARK {
+        const auto filePath = m_dir.filePath(u"%1-%2.png"_s.arg(QString::fromLatin1(QTest::currentDataTag())).arg(i++));
+        QCOMPARE(capture(size, filePath), 0);
+        QVERIFY(QFile::exists(filePath));
+    }
+}
+
+// Runs the built spectacle -b -n -o, so process startup and platform loading are included.
+// This takes real screenshots of the desktop, so it only runs if SPECTACLE_BENCHMARK_PROCESS is set.
+// Set SPECTACLE_HEADLESS_BUDGET_MS to also fail if one run takes longer than that.
+void HeadlessCaptureBenchmark::benchmarkProcess()
+{
+    if (!qEnvironmentVariableIsSet("SPECTACLE_BENCHMARK_PROCESS")) {
+        QSKIP("Set SPECTACLE_BENCHMARK_PROCESS to benchmark screenshots of the desktop with the spectacle binary");
+    }
+    const auto program = QString::fromUtf8(SPECTACLE_BINARY);
+    if (!QFileInfo(program).isExecutable()) {
+        QSKIP("The spectacle binary has not been built");
+    }
+    auto environment = QProcessEnvironment::systemEnvironment();
+    // Don't touch the configuration of the user running the benchmark.
+    for (const auto &name : {u"XDG_CONFIG_HOME"_s, u"XDG_DATA_HOME"_s, u"XDG_STATE_HOME"_s, u"XDG_CACHE_HOME"_s}) {
+        environment.insert(name, m_dir.filePath(name));
+    }
+    int i = 0;
+    auto run = [&] {
+        QProcess process;
+        process.setProcessEnvironment(environment);
+        process.start(program, {u"-b"_s, u"-n"_s, u"-o"_s, m_dir.filePath(u"process-%1.png"_s.arg(i++))});
+        return process.waitForFinished(30000) && process.exitStatus() == QProcess::NormalExit ? process.exitCode() : -1;
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    if (run() != 0) {
+        QSKIP("spectacle can't take screenshots in this environment");
+    }
+    const auto elapsed = timer.elapsed();
+    bool ok = false;
+    const qint64 budgetMsec = qEnvironmentVariableIntValue("SPECTACLE_HEADLESS_BUDGET_MS", &ok);
+    if (ok) {
+        QVERIFY2(elapsed <= budgetMsec, qPrintable(u"%1 ms is over the %2 ms budget"_s.arg(elapsed).arg(budgetMsec)));
+    }
+
+    QBENCHMARK {
+        QCOMPARE(run(), 0);
+    }
+}
+
+QTEST_GUILESS_MAIN(HeadlessCaptureBenchmark)
+
+#include "HeadlessCaptureBenchmark.moc"
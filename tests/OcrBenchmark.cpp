@@ -0,0 +1,246 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-only OR LGPL-2.0-only OR LicenseRef-KDE-Accepted-GPL
+ */
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFontMetrics>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QRegularExpression>
+#include <QTest>
+
+#include <tesseract/capi.h>
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+#include "OcrPreprocessor.h"
+
+using namespace Qt::StringLiterals;
+
+class OcrBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    struct Fixture {
+        QString name;
+        QImage image;
+        QString text;
+        // Rendered fixtures depend on the fonts of the machine running the test.
+        bool rendered = false;
+    };
+
+    enum Mode {
+        Rgb, //< What OcrWorker did before preprocessing was added.
+        Grayscale,
+        Preprocessed, //< What OcrWorker does by default.
+        Upscaled, //< Preprocessed with the optional 2x upscale.
+    };
+
+    static QImage renderFixture(const QJsonObject &object);
+    static QString normalized(const QString &text);
+    static qreal accuracy(const QString &expected, const QString &actual);
+    QString recognize(const QImage &image, Mode mode);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testAccuracy();
+    void benchmarkRecognition_data();
+    void benchmarkRecognition();
+
+private:
+    QList<Fixture> m_fixtures;
+    TessBaseAPI *m_tesseract = nullptr;
+    OcrPreprocessor m_preprocessor;
+};
+
+// Fixtures are described in corpus.json and rendered with the given font and colors.
+// The font is looked up on the machine running the test, so the result varies between machines.
+QImage OcrBenchmark::renderFixture(const QJsonObject &object)
+{
+    QFont font(object["font"_L1].toString());
+    font.setPixelSize(object["pixelSize"_L1].toInt());
+    const qreal dpr = object["devicePixelRatio"_L1].toDouble(1);
+    const auto lines = object["lines"_L1].toArray();
+
+    const QFontMetrics metrics(font);
+    constexpr int margin = 16;
+    int width = 0;
+    for (const auto &line : lines) {
+        width = std::max(width, metrics.horizontalAdvance(line.toString()));
+    }
+    const QSize size(width + margin * 2, metrics.lineSpacing() * lines.size() + margin * 2);
+
+    QImage image(size * dpr, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(dpr);
+    QPainter painter(&image);
+    const QColor background(object["background"_L1].toString());
+    if (object.contains("gradient"_L1)) {
+        QLinearGradient gradient(0, 0, size.width(), 0);
+        gradient.setColorAt(0, background);
+        gradient.setColorAt(1, QColor(object["gradient"_L1].toString()));
+        painter.fillRect(QRect({0, 0}, size), gradient);
+    } else {
+        painter.fillRect(QRect({0, 0}, size), background);
+    }
+    painter.setFont(font);
+    painter.setPen(QColor(object["foreground"_L1].toString()));
+    for (int i = 0; i < lines.size(); ++i) {
+        painter.drawText(margin, margin + metrics.ascent() + metrics.lineSpacing() * i, lines[i].toString());
+    }
+    return image;
+}
+
+QString OcrBenchmark::normalized(const QString &text)
+{
+    static const QRegularExpression whitespace(u"\\s+"_s);
+    return QString(text).replace(whitespace, u" "_s).trimmed();
+}
+
+// 1 - character error rate, using the Levenshtein distance.
+qreal OcrBenchmark::accuracy(const QString &expected, const QString &actual)
+{
+    if (expected.isEmpty()) {
+        return actual.isEmpty() ? 1 : 0;
+    }
+    QList<int> previous(actual.size() + 1);
+    QList<int> current(actual.size() + 1);
+    std::iota(previous.begin(), previous.end(), 0);
+    for (qsizetype i = 1; i <= expected.size(); ++i) {
+        current[0] = i;
+        for (qsizetype j = 1; j <= actual.size(); ++j) {
+            const int substitution = previous[j - 1] + (expected[i - 1] == actual[j - 1] ? 0 : 1);
+            current[j] = std::min({previous[j] + 1, current[j - 1] + 1, substitution});
+        }
+        std::swap(previous, current);
+    }
+    return std::max<qreal>(0, 1 - qreal(previous[actual.size()]) / expected.size());
+}
+
+QString OcrBenchmark::recognize(const QImage &image, Mode mode)
+{
+    QImage rgbImage;
+    if (mode == Rgb) {
+        rgbImage = image.convertToFormat(QImage::Format_RGB888);
+        m_tesseract->SetImage(rgbImage.constBits(), rgbImage.width(), rgbImage.height(), 3, rgbImage.bytesPerLine());
+    } else {
+        m_preprocessor.setUpscaleEnabled(mode == Upscaled);
+        m_preprocessor.setBinarizationEnabled(mode != Grayscale);
+        const QImage &grayImage = m_preprocessor.process(image);
+        m_tesseract->SetImage(grayImage.constBits(), grayImage.width(), grayImage.height(), 1, grayImage.bytesPerLine());
+        m_tesseract->SetSourceResolution(m_preprocessor.resolution());
+    }
+    char *text = m_tesseract->GetUTF8Text();
+    const QString result = QString::fromUtf8(text);
+    delete[] text;
+    m_tesseract->Clear();
+    return normalized(result);
+}
+
+void OcrBenchmark::initTestCase()
+{
+    m_tesseract = new TessBaseAPI;
+    if (m_tesseract->Init(nullptr, "eng") != 0) {
+        QSKIP("Tesseract with English language data is not available");
+    }
+    m_tesseract->SetPageSegMode(tesseract::PSM_AUTO);
+
+    const auto corpusPath = QFINDTESTDATA("data/ocr/corpus.json");
+    QFile corpusFile(corpusPath);
+    QVERIFY(corpusFile.open(QIODevice::ReadOnly));
+    const auto corpus = QJsonDocument::fromJson(corpusFile.readAll()).array();
+    for (const auto &value : corpus) {
+        const auto object = value.toObject();
+        QStringList lines;
+        for (const auto &line : object["lines"_L1].toArray()) {
+            lines << line.toString();
+        }
+        m_fixtures.append({object["name"_L1].toString(), renderFixture(object), normalized(lines.join(u' ')), true});
+    }
+
+    // Real screenshots can be added as <name>.png with the expected text in <name>.txt.
+    const QDir corpusDir = QFileInfo(corpusPath).dir();
+    const auto screenshots = corpusDir.entryInfoList({u"*.png"_s}, QDir::Files, QDir::Name);
+    for (const auto &info : screenshots) {
+        QFile textFile(info.dir().filePath(info.completeBaseName() + u".txt"_s));
+        if (!textFile.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        m_fixtures.append({info.completeBaseName(), QImage(info.filePath()), normalized(QString::fromUtf8(textFile.readAll())), false});
+    }
+    QVERIFY(!m_fixtures.isEmpty());
+}
+
+void OcrBenchmark::cleanupTestCase()
+{
+    if (m_tesseract) {
+        m_tesseract->End();
+        delete m_tesseract;
+        m_tesseract = nullptr;
+    }
+}
+
+// Preprocessing must not make recognition of the checked in screenshots worse on average.
+// The accuracy of rendered fixtures is only printed, since it depends on the installed fonts.
+void OcrBenchmark::testAccuracy()
+{
+    constexpr std::array modes{Rgb, Grayscale, Preprocessed, Upscaled};
+    constexpr std::array modeNames{"rgb", "grayscale", "preprocessed", "upscaled"};
+    std::array<qreal, modes.size()> totals = {};
+    std::array<qreal, modes.size()> screenshotTotals = {};
+    int screenshotCount = 0;
+    for (const auto &fixture : std::as_const(m_fixtures)) {
+        QString row = fixture.name;
+        for (size_t i = 0; i < modes.size(); ++i) {
+            const qreal value = accuracy(fixture.text, recognize(fixture.image, modes[i]));
+            totals[i] += value;
+            if (!fixture.rendered) {
+                screenshotTotals[i] += value;
+            }
+            row += u"  %1: %2"_s.arg(QString::fromLatin1(modeNames[i])).arg(value, 0, 'f', 3);
+        }
+        screenshotCount += !fixture.rendered;
+        qInfo().noquote() << row;
+    }
+    for (size_t i = 0; i < modes.size(); ++i) {
+        qInfo().noquote() << u"mean %1 accuracy: %2"_s.arg(QString::fromLatin1(modeNames[i])).arg(totals[i] / m_fixtures.size(), 0, 'f', 3);
+    }
+    if (screenshotCount == 0) {
+        QSKIP("There are no screenshots in tests/data/ocr to compare the accuracy with");
+    }
+    QVERIFY(screenshotTotals[Preprocessed] / screenshotCount >= screenshotTotals[Rgb] / screenshotCount - 0.02);
+}
+
+void OcrBenchmark::benchmarkRecognition_data()
+{
+    QTest::addColumn<int>("fixture");
+    QTest::addColumn<int>("mode");
+    for (int i = 0; i < m_fixtures.size(); ++i) {
+        const auto name = m_fixtures[i].name.toUtf8();
+        QTest::addRow("%s rgb", name.constData()) << i << int(Rgb);
+        QTest::addRow("%s preprocessed", name.constData()) << i << int(Preprocessed);
+        QTest::addRow("%s upscaled", name.constData()) << i << int(Upscaled);
+    }
+}
+
+void OcrBenchmark::benchmarkRecognition()
+{
+    QFETCH(int, fixture);
+    QFETCH(int, mode);
+    const auto &image = m_fixtures[fixture].image;
+    QBENCHMARK {
+        recognize(image, Mode(mode));
+    }
+}
+
+QTEST_MAIN(OcrBenchmark)
+
+#include "OcrBenchmark.moc"
@@ -0,0 +1,115 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-only OR LGPL-2.0-only OR LicenseRef-KDE-Accepted-GPL
+ */
+
+#include <QSignalSpy>
+#include <QTest>
+
+#include "OcrResult.h"
+#include "OcrResultModel.h"
+
+using namespace Qt::StringLiterals;
+
+class OcrResultTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    // One block per call, with the given lines of space separated words laid out on a grid.
+    static OcrResult block(const QStringList &lines, const QPointF &origin);
+
+private Q_SLOTS:
+    void testText();
+    void testTextInRect();
+    void testFind();
+    void testAppend();
+    void testModel();
+};
+
+OcrResult OcrResultTest::block(const QStringList &lines, const QPointF &origin)
+{
+    constexpr qreal wordWidth = 100;
+    constexpr qreal lineHeight = 20;
+    OcrResult result;
+    result.blocks.append({QRectF(), 90, 0, 0});
+    for (int l = 0; l < lines.size(); ++l) {
+        const auto words = lines[l].split(u' ');
+        result.lines.append({QRectF(origin + QPointF(0, l * lineHeight), QSizeF(wordWidth * words.size(), lineHeight)), 90, 0, int(result.words.size()), 0});
+        for (int w = 0; w < words.size(); ++w) {
+            result.words.append({words[w], QRectF(origin + QPointF(w * wordWidth, l * lineHeight), QSizeF(wordWidth - 10, lineHeight - 4)), 90, l});
+            ++result.lines.last().wordCount;
+        }
+        ++result.blocks.last().lineCount;
+    }
+    return result;
+}
+
+void OcrResultTest::testText()
+{
+    QCOMPARE(OcrResult().text(), QString());
+    const auto result = block({u"Hello world"_s, u"second line"_s}, {0, 0});
+    QCOMPARE(result.text(), u"Hello world\nsecond line"_s);
+}
+
+void OcrResultTest::testTextInRect()
+{
+    const auto result = block({u"one two three"_s, u"four five six"_s}, {0, 0});
+    // The second and third column of both lines.
+    QCOMPARE(result.text(QRectF(100, 0, 200, 40)), u"two three\nfive six"_s);
+    // Only words whose center is inside count.
+    QCOMPARE(result.text(QRectF(0, 0, 30, 40)), QString());
+    QCOMPARE(result.text(QRectF(0, 20, 60, 20)), u"four"_s);
+}
+
+void OcrResultTest::testFind()
+{
+    const auto result = block({u"Spectacle takes screenshots"_s, u"spectacles"_s}, {0, 0});
+    QCOMPARE(result.find(u"spectacle"_s), QList<int>({0, 3}));
+    QCOMPARE(result.find(u"SHOT"_s), QList<int>({2}));
+    QCOMPARE(result.find(u"missing"_s), QList<int>());
+    QCOMPARE(result.find(QString()), QList<int>());
+}
+
+void OcrResultTest::testAppend()
+{
+    auto result = block({u"first block"_s}, {0, 0});
+    result.append(block({u"second block"_s, u"has two lines"_s}, {0, 100}));
+
+    QCOMPARE(result.blocks.size(), 2);
+    QCOMPARE(result.lines.size(), 3);
+    QCOMPARE(result.words.size(), 7);
+    QCOMPARE(result.blocks[1].firstLine, 1);
+    QCOMPARE(result.blocks[1].lineCount, 2);
+    QCOMPARE(result.lines[2].block, 1);
+    QCOMPARE(result.lines[2].firstWord, 4);
+    QCOMPARE(result.words[4].text, u"has"_s);
+    QCOMPARE(result.words[4].line, 2);
+    QCOMPARE(result.text(), u"first block\nsecond block\nhas two lines"_s);
+}
+
+void OcrResultTest::testModel()
+{
+    OcrResultModel model;
+    QSignalSpy countSpy(&model, &OcrResultModel::countChanged);
+    QCOMPARE(model.rowCount(), 0);
+
+    auto result = block({u"first block"_s}, {0, 0});
+    result.append(block({u"second"_s}, {0, 100}));
+    model.setResult(result);
+    QCOMPARE(countSpy.count(), 1);
+    QCOMPARE(model.rowCount(), 3);
+    QCOMPARE(model.text(), u"first block\nsecond"_s);
+
+    const auto index = model.index(2);
+    QCOMPARE(index.data(Qt::DisplayRole).toString(), u"second"_s);
+    QCOMPARE(index.data(OcrResultModel::RectRole).toRectF(), QRectF(0, 100, 90, 16));
+    QCOMPARE(index.data(OcrResultModel::LineRole).toInt(), 1);
+    QCOMPARE(index.data(OcrResultModel::BlockRole).toInt(), 1);
+
+    QCOMPARE(model.textInRect(QRectF(0, 90, 200, 40)), u"second"_s);
+    QCOMPARE(model.find(u"block"_s), QList<QRectF>({QRectF(100, 0, 90, 16)}));
+}
+
+QTEST_GUILESS_MAIN(OcrResultTest)
+
+#include "OcrResultTest.moc"
@@ -0,0 +1,134 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-only OR LGPL-2.0-only OR LicenseRef-KDE-Accepted-GPL
+ */
+
+#include <QFont>
+#include <QPainter>
+#include <QSignalSpy>
+#include <QTest>
+
+#include "OcrManager.h"
+
+#include <algorithm>
+
+using namespace Qt::StringLiterals;
+
+class OcrWorkerTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    struct TextBlock {
+        QRect rect;
+        QStringList lines;
+    };
+
+    // Blocks far apart from each other, in reading order, on an image large enough to be split.
+    static QList<TextBlock> textBlocks();
+    static QImage render(const QList<TextBlock> &blocks);
+    OcrResult recognize(const QImage &image, int engineCount);
+
+private Q_SLOTS:
+    void initTestCase();
+    void testBlocks();
+
+private:
+    QString m_datapath;
+    quint64 m_lastRequestId = 0;
+};
+
+QList<OcrWorkerTest::TextBlock> OcrWorkerTest::textBlocks()
+{
+    return {
+        {QRect(80, 80, 800, 200), {u"Alpha bravo charlie"_s, u"delta echo foxtrot"_s}},
+        {QRect(1040, 520, 800, 200), {u"golf hotel india"_s, u"juliett kilo lima"_s}},
+        {QRect(80, 880, 800, 200), {u"mike november oscar"_s, u"papa quebec romeo"_s}},
+    };
+}
+
+QImage OcrWorkerTest::render(const QList<TextBlock> &blocks)
+{
+    QImage image(1920, 1200, QImage::Format_RGB32);
+    image.fill(Qt::white);
+    QPainter painter(&image);
+    QFont font(u"Sans Serif"_s);
+    font.setPixelSize(48);
+    painter.setFont(font);
+    painter.setPen(Qt::black);
+    for (const auto &block : blocks) {
+        painter.drawText(block.rect, Qt::AlignLeft | Qt::AlignTop, block.lines.join(u'\n'));
+    }
+    return image;
+}
+
+OcrResult OcrWorkerTest::recognize(const QImage &image, int engineCount)
+{
+    OcrWorker worker;
+    worker.setMaxEngineCount(engineCount);
+    QSignalSpy spy(&worker, &OcrWorker::imageProcessed);
+    const quint64 requestId = ++m_lastRequestId;
+    worker.processImage(requestId, image, m_datapath, u"eng"_s);
+    if (spy.size() != 1 || spy.constFirst().at(0).value<quint64>() != requestId || !spy.constFirst().at(2).toBool()) {
+        return {};
+    }
+    return spy.constFirst().at(1).value<OcrResult>();
+}
+
+void OcrWorkerTest::initTestCase()
+{
+    TessBaseAPI tesseract;
+    if (tesseract.Init(nullptr, "eng") != 0) {
+        QSKIP("Tesseract with English language data is not available");
+    }
+    m_datapath = QString::fromUtf8(tesseract.GetDatapath());
+    tesseract.End();
+}
+
+// Blocks recognized in parallel must be merged in reading order and at their position in the image.
+void OcrWorkerTest::testBlocks()
+{
+    const auto blocks = textBlocks();
+    const auto image = render(blocks);
+
+    const auto serial = recognize(image, 1);
+    const auto parallel = recognize(image, 2);
+    QVERIFY(!serial.words.isEmpty());
+    QVERIFY(parallel.blocks.size() >= blocks.size());
+
+    QStringList serialWords;
+    for (const auto &word : serial.words) {
+        serialWords << word.text;
+    }
+    QStringList parallelWords;
+    for (const auto &word : parallel.words) {
+        parallelWords << word.text;
+    }
+    QCOMPARE(parallelWords, serialWords);
+
+    for (qsizetype i = 0; i < parallel.words.size(); ++i) {
+        const auto &word = parallel.words[i];
+        const auto offset = word.rect.center() - serial.words[i].rect.center();
+        QVERIFY2(offset.manhattanLength() <= 8, qPrintable(word.text));
+        // Every word is inside the block it was drawn in.
+        QVERIFY2(std::any_of(blocks.cbegin(), blocks.cend(), [&word](const TextBlock &block) {
+                     return block.rect.contains(word.rect.center().toPoint());
+                 }),
+                 qPrintable(word.text));
+    }
+
+    // Lines and blocks refer to the merged words.
+    for (int i = 0; i < parallel.lines.size(); ++i) {
+        const auto &line = parallel.lines[i];
+        QVERIFY(line.firstWord + line.wordCount <= parallel.words.size());
+        QCOMPARE(parallel.words[line.firstWord].line, i);
+    }
+    for (int i = 0; i < parallel.blocks.size(); ++i) {
+        const auto &block = parallel.blocks[i];
+        QVERIFY(block.firstLine + block.lineCount <= parallel.lines.size());
+        QCOMPARE(parallel.lines[block.firstLine].block, i);
+    }
+}
+
+QTEST_MAIN(OcrWorkerTest)
+
+#include "OcrWorkerTest.moc"